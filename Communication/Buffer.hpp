@@ -2,9 +2,17 @@
 
 #include "Error.hpp"
 #include "Traits.hpp"
+#include "Hash.hpp"
+#include "Varint.hpp"
+#include "Endian.hpp"
 
 namespace Communication
 {
+	/**
+	 * Header of every buffer: a 1-byte type tag followed by the data size as a LEB128 varint.
+	 * Integer values (Int, Size_T) are themselves varints, zigzag-encoded for Int; the other values
+	 * use the fixed-width little-endian wire format of Endian.hpp.
+	 */
 	class Buffer
 	{
 	public:
@@ -22,57 +30,92 @@ namespace Communication
 			Vector,
 			Pair,
 			Map,
-			Custom
+			Custom,
+			Array,		// Contiguous fundamental values: the 1-byte element type tag followed by the elements in wire format
+			Stream,		// Start of a stream: the 64-bit element count, the elements follow in Vector or Array chunks
+			Control,	// Connection management (e.g. flow control credits), see Protocol::Control
+			Slice,		// Part of a frame of a logical channel: the channel number, then the next bytes of the frame
+			Columns		// Vector of records stored by field: the record count, then the name and the column of every field
 		};
 
 	private:
 		size_t dataSize = 0;
 		size_t size = 0;
+		size_t headerSize = 0;
+		size_t capacity = 0;		// Bytes of malloc memory owned by the buffer, 0 if the memory is not owned or not from malloc
 		BufferType type = BufferType::Custom;
 		std::unique_ptr<void, void(*)(void *)> buf;
-		static constexpr size_t headerSize = sizeof(BufferType) + sizeof(dataSize);
+		static constexpr unsigned char varintFlag = 0x80;		// Set in the type tag when the payload is a varint
+
+		static void freeBytes(void* bytes)
+		{
+			std::free(bytes);
+		}
+		static void keepBytes(void*) {}
 
 	public:
+		/** The largest header: the type tag and a 64-bit data size. */
+		static constexpr size_t maxHeaderSize = 1 + Varint::maxSize;
+
 		Buffer()
 			: dataSize(0)
 			, size(0)
+			, headerSize(0)
 			, type(BufferType::Custom)
 			, buf(nullptr, nullptr) {}
 
 		/** Buffer constructed from byte array (deserialization), takes ownership. */
 		Buffer(void*&& bytes)
-			: dataSize(*reinterpret_cast<decltype(dataSize) *>((static_cast<char *>(bytes) + sizeof(BufferType))))
-			, size(headerSize + dataSize)
-			, type(*static_cast<BufferType *>(bytes))
-			, buf(bytes, [](void *buf) { std::free(buf); }) {}
+			: Buffer(std::move(bytes), freeBytes)
+		{
+			capacity = size;
+		}
+
+		/** Buffer constructed from byte array not allocated with malloc (e.g. a mapped file view), takes ownership. */
+		Buffer(void*&& bytes, void(*deleter)(void *))
+			: buf(bytes, deleter)
+		{
+			headerSize = readHeader(bytes, maxHeaderSize, type, dataSize);
+			assert(headerSize != 0, "Header-ul bufferului nu este valid.");
+			size = headerSize + dataSize;
+		}
 
 		/** Constructs a buffer directly from a fundamental type value. */
 		template<typename T> Buffer(T value)
-			: dataSize(sizeof(T))
-			, size(headerSize + dataSize)
-			, type(TypeEnumFromTypeName<T>::value)
-			, buf(std::malloc(size), [] (void *buf) { std::free(buf); })
+			: type(TypeEnumFromTypeName<T>::value)
+			, buf(nullptr, freeBytes)
 		{
 			static_assert(getGeneralType<T>() == GeneralType::FundamentalType, "Fundamental type required for this overload.");
-			assert(buf != nullptr, "Eroare la alocare memorie de ", size, " bytes.");
 
-			*static_cast<BufferType *>(buf.get()) = type;
-			*reinterpret_cast<decltype(dataSize) *>(static_cast<char *>(buf.get()) + sizeof(BufferType)) = dataSize;
-			*reinterpret_cast<T *>(static_cast<char *>(buf.get()) + headerSize) = value;
+			unsigned char payload[Varint::maxSize];
+			bool varintPayload = false;
+			if constexpr (std::is_same<T, int>::value)
+			{
+				dataSize = Varint::encode(Varint::zigzagEncode(value), payload);
+				varintPayload = true;
+			}
+			else if constexpr (std::is_same<T, size_t>::value || std::is_same<T, uint64_t>::value)
+			{
+				dataSize = Varint::encode(value, payload);
+				varintPayload = true;
+			}
+			else
+			{
+				dataSize = Endian::wireSize<T>();
+				Endian::toWire(&value, 1, payload);
+			}
+			allocate(varintPayload);
+			std::memcpy(static_cast<char *>(buf.get()) + headerSize, payload, dataSize);
 		}
 
 		/** Constructs a buffer directly from a string. */
 		template<typename CharType> Buffer(const std::basic_string<CharType>& string)
-			: dataSize(sizeof(CharType) * (string.length() + 1))
-			, size(headerSize + dataSize)
+			: dataSize(Endian::wireSize<CharType>() * (string.length() + 1))
 			, type(TypeEnumFromTypeName<std::basic_string<CharType>>::value)
-			, buf(std::malloc(size), [] (void *buf) { std::free(buf); })
+			, buf(nullptr, freeBytes)
 		{
-			assert(buf != nullptr, "Eroare la alocare memorie de ", size, " bytes.");
-
-			*static_cast<BufferType *>(buf.get()) = type;
-			*reinterpret_cast<decltype(dataSize) *>(static_cast<char *>(buf.get()) + sizeof(BufferType)) = dataSize;
-			std::memcpy(static_cast<char *>(buf.get()) + headerSize, string.c_str(), dataSize);
+			allocate();
+			Endian::toWire(string.c_str(), string.length() + 1, static_cast<char *>(buf.get()) + headerSize);
 		}
 
 		/** Disabling buffer construction from pointers. */
@@ -84,14 +127,25 @@ namespace Communication
 	private:
 		/** Buffer constructed from byte array (deserialization), does not take ownership. */
 		Buffer(const void*& bytes)
-			: dataSize(*reinterpret_cast<const decltype(dataSize) *>((static_cast<const char *>(bytes) + sizeof(BufferType))))
-			, size(headerSize + dataSize)
-			, type(*static_cast<const BufferType *>(bytes))
-			, buf(std::malloc(size), [](void *buf) { std::free(buf); })
+			: buf(nullptr, freeBytes)
 		{
+			headerSize = readHeader(bytes, maxHeaderSize, type, dataSize);
+			size = capacity = headerSize + dataSize;
+			buf.reset(std::malloc(size));
+			assert(buf != nullptr, "Eroare la alocare memorie de ", size, " bytes.");
 			std::memcpy(buf.get(), bytes, size);
 		}
 
+		/** Allocates the buffer for the current type and data size and writes the header. */
+		void allocate(bool varintPayload = false)
+		{
+			headerSize = getHeaderSize(dataSize);
+			size = capacity = headerSize + dataSize;
+			buf.reset(std::malloc(size));
+			assert(buf != nullptr, "Eroare la alocare memorie de ", size, " bytes.");
+			writeHeader(buf.get(), type, dataSize, varintPayload);
+		}
+
 		///** Buffer owns the byte array, byte array parameter does not include header, create it. */
 		//Buffer(void*&& buffer, decltype(dataSize) dataSize, decltype(type) type):
 		//	dataSize(dataSize),
@@ -129,22 +183,27 @@ namespace Communication
 		Buffer(const Buffer& other):
 			dataSize(other.dataSize),
 			size(other.size),
+			headerSize(other.headerSize),
+			capacity(other.size),
 			type(other.type),
-			buf(std::malloc(size), [](void *buf) { std::free(buf); })
+			buf(std::malloc(size), freeBytes)
 		{
-			void* dataStartAddress = static_cast<char *>(buf.get()) + headerSize;
-			std::memcpy(dataStartAddress, other, dataSize);
+			if (size != 0)
+				std::memcpy(buf.get(), other, size);
 		}
 		void operator =(const Buffer&) = delete;
 
 		Buffer(Buffer&& other) noexcept:
 			dataSize(other.dataSize),
 			size(other.size),
+			headerSize(other.headerSize),
+			capacity(other.capacity),
 			type(other.type),
 			buf(std::move(other.buf))
 		{
 			other.size = 0;
 			other.dataSize = 0;
+			other.capacity = 0;
 		}
 		//void operator =(Buffer&& other) = delete;
 		void operator =(Buffer&& other) noexcept
@@ -154,9 +213,48 @@ namespace Communication
 			buf = std::move(other.buf);
 			size = other.size;
 			dataSize = other.dataSize;
+			headerSize = other.headerSize;
+			capacity = other.capacity;
 			type = other.type;
 			other.size = 0;
 			other.dataSize = 0;
+			other.capacity = 0;
+		}
+
+		/** Buffer over bytes owned by someone else, valid while they are. Nothing is copied or allocated. */
+		static Buffer view(const void* bytes)
+		{
+			return Buffer(std::move(const_cast<void *>(bytes)), keepBytes);
+		}
+
+		/**
+		 * Storage for size bytes, to be filled with a whole buffer (header included) and followed by adoptStorage.
+		 * The memory of the buffer is reused when it is large enough, so receiving buffers of recurring sizes
+		 * into the same object does not allocate. The previous content is lost; nullptr if out of memory.
+		 */
+		void* getStorage(size_t size)
+		{
+			if (capacity < size)
+			{
+				buf = std::unique_ptr<void, void(*)(void *)>(std::malloc(size), freeBytes);
+				capacity = buf != nullptr ? size : 0;
+			}
+			this->size = dataSize = headerSize = 0;
+			type = BufferType::Custom;
+			return buf.get();
+		}
+		/** Reads the header of the buffer written to the memory given by getStorage. */
+		void adoptStorage()
+		{
+			headerSize = readHeader(buf.get(), capacity, type, dataSize);
+			assert(headerSize != 0 && headerSize + dataSize <= capacity, "Header-ul bufferului nu este valid.");
+			size = headerSize + dataSize;
+		}
+
+		/** True for buffers made by view, whose bytes may be released by their owner at any time. */
+		bool isView() const
+		{
+			return buf.get_deleter() == keepBytes;
 		}
 
 		operator const void*() const
@@ -171,11 +269,65 @@ namespace Communication
 		{
 			return size;
 		}
+		size_t getDataSize() const
+		{
+			return dataSize;
+		}
 		BufferType getType() const
 		{
 			return type;
 		}
 
+		size_t getHeaderSize() const
+		{
+			return headerSize;
+		}
+
+		/** Decodes the value of a buffer constructed from a fundamental type value. */
+		template<typename T> T getValue() const
+		{
+			if (*static_cast<const unsigned char *>(buf.get()) & varintFlag)
+			{
+				uint64_t value = 0;
+				Varint::decode(getData(), dataSize, value);
+				if constexpr (std::is_same<T, int>::value)
+					return T(Varint::zigzagDecode(value));
+				else
+					return T(value);
+			}
+			T value;
+			Endian::fromWire(getData(), 1, &value);
+			return value;
+		}
+
+		/** Size of the header of a buffer with dataSize bytes of data. */
+		static size_t getHeaderSize(size_t dataSize)
+		{
+			return 1 + Varint::encodedSize(dataSize);
+		}
+		/** Writes the header of a buffer whose data follows the header, returns the size of the header. */
+		static size_t writeHeader(void* destination, BufferType type, size_t dataSize, bool varintPayload = false)
+		{
+			unsigned char* bytes = static_cast<unsigned char *>(destination);
+			bytes[0] = static_cast<unsigned char>(type) | (varintPayload ? varintFlag : 0);
+			return 1 + Varint::encode(dataSize, bytes + 1);
+		}
+		/** Reads a header from at most available bytes, returns the size of the header or 0 if it is incomplete or invalid. */
+		static size_t readHeader(const void* source, size_t available, BufferType& type, size_t& dataSize)
+		{
+			if (available < 1)
+				return 0;
+			const unsigned char* bytes = static_cast<const unsigned char *>(source);
+			uint64_t size = 0;
+			const size_t sizeLength = Varint::decode(bytes + 1, available - 1, size);
+			if (sizeLength == 0 || size > SIZE_MAX)
+				return 0;
+
+			type = BufferType(bytes[0] & ~varintFlag);
+			dataSize = size_t(size);
+			return 1 + sizeLength;
+		}
+
 	private:
 		template<typename T>				struct _TypeEnumFromTypeName { static const BufferType value = BufferType::Custom; };
 		template<>							struct _TypeEnumFromTypeName<bool> { static const BufferType value = BufferType::Bool; };
@@ -192,37 +344,80 @@ namespace Communication
 		template<typename T, typename Y>	struct _TypeEnumFromTypeName<std::map<T, Y>> { static const BufferType value = BufferType::Map; };
 
 	public:
-		template<typename T>				struct TypeEnumFromTypeName { static const BufferType value = _TypeEnumFromTypeName<remove_reference_and_const<T>::type>::value; };
+		/** uint64_t is sent as a Size_T where it is not the same type as size_t (Win32), both have 64 bits on the wire. */
+		template<typename T>				struct TypeEnumFromTypeName
+		{
+			using Type = remove_reference_and_const<T>::type;
+			static const BufferType value = std::is_same<Type, uint64_t>::value ? BufferType::Size_T : _TypeEnumFromTypeName<Type>::value;
+		};
 
 	private:
 		//template<Type type, GeneralType generalType = getGeneralType(type)> static Buffer getBufferFromBytes(const void* bytes)
 
+		/** Copies in blocks small enough to be hashed while they are still in the cache. */
+		static void copyAndHash(void* destination, const void* source, size_t size, Hasher& hasher)
+		{
+			constexpr size_t blockSize = 16 * 1024;
+			for (size_t offset = 0; offset < size; offset += blockSize)
+			{
+				const size_t length = size - offset < blockSize ? size - offset : blockSize;
+				char* block = static_cast<char *>(destination) + offset;
+				std::memcpy(block, static_cast<const char *>(source) + offset, length);
+				hasher.update(block, length);
+			}
+		}
+
 	public:
-		/** Concatenates the buffers into a single, larger, one and destroys the initial buffers. */
-		static Buffer packBuffers(const std::vector<const Buffer *>& buffers, const BufferType type = BufferType::Custom)
+		/**
+		 * Concatenates the buffers into a single, larger, one and destroys the initial buffers.
+		 * If a hasher is given, the bytes of the result are hashed while they are copied, the digest is
+		 * the same as hashing the whole result afterwards.
+		 */
+		static Buffer packBuffers(const std::vector<const Buffer *>& buffers, const BufferType type = BufferType::Custom, Hasher* hasher = nullptr)
 		{
-			size_t totalSize = headerSize;
+			size_t dataSize = 0;
 			for (const Buffer* buffer : buffers)
-				totalSize += buffer->size;
+			{
+				// A buffer without header would leave the parts that follow it unreadable
+				assert(buffer->size != 0, "Nu se poate impacheta un buffer gol, fara header.");
+				dataSize += buffer->size;
+			}
+			const size_t headerSize = getHeaderSize(dataSize);
+			const size_t totalSize = headerSize + dataSize;
 			void *mergedBuffer = std::malloc(totalSize);
 			assert(mergedBuffer != nullptr, "Eroare la alocare memorie de ", totalSize, " bytes.");
 
-			*static_cast<BufferType *>(mergedBuffer) = type;
-			*reinterpret_cast<decltype(dataSize) *>(static_cast<char *>(mergedBuffer) + sizeof(BufferType)) = totalSize - headerSize;
+			writeHeader(mergedBuffer, type, dataSize);
+			if (hasher != nullptr)
+				hasher->update(mergedBuffer, headerSize);
 			size_t offset = headerSize;
 			for (const Buffer* buffer : buffers)
 			{
-				std::memcpy(static_cast<char *>(mergedBuffer) + offset, *buffer, buffer->size);
+				if (hasher == nullptr)
+					std::memcpy(static_cast<char *>(mergedBuffer) + offset, *buffer, buffer->size);
+				else
+					copyAndHash(static_cast<char *>(mergedBuffer) + offset, *buffer, buffer->size, *hasher);
 				offset += buffer->size;
 			}
 			return Buffer(std::move(mergedBuffer));
 		}
 
+		/** Calls function with a view of every component of a packed buffer, without copying them. */
+		template<typename Function> static void forEachPart(const Buffer& mergedBuffer, Function&& function)
+		{
+			for (size_t offset = mergedBuffer.headerSize; offset < mergedBuffer.size; )
+			{
+				const Buffer part = view(static_cast<const char *>(static_cast<const void *>(mergedBuffer)) + offset);
+				offset += part.getSize();
+				function(part);
+			}
+		}
+
 		/** Splits a large buffer into its components and destroys the initial buffer. */
 		static std::vector<Buffer> unpackBuffer(const Buffer& mergedBuffer)
 		{
 			std::vector<Buffer> result;
-			for (size_t offset = headerSize; offset < mergedBuffer.size; )
+			for (size_t offset = mergedBuffer.headerSize; offset < mergedBuffer.size; )
 			{
 				const void* startBuffer = static_cast<const char *>(static_cast<const void *>(mergedBuffer)) + offset;
 				Buffer buffer(startBuffer);
@@ -2,17 +2,85 @@
 
 #include <string>
 #include <Buffer.hpp>
+#include <Protocol.hpp>
+#include <Deadline.hpp>
 
 namespace Communication
 {
+	class FileRegion;
+
+	/**
+	 * Operations that take a deadline return WSAETIMEDOUT when it passes. A timeout while waiting for a frame to
+	 * start, or while a queued frame waits, leaves the connection usable; one in the middle of a received frame
+	 * does not, and the later calls return WSAETIMEDOUT too.
+	 */
 	class ClientSocket
 	{
 	public:
 		virtual ~ClientSocket() = default;
 
-		virtual int connect(const std::string& hostname, int port) = 0;
+		virtual int connect(const std::string& hostname, int port, const Deadline& deadline = Deadline()) = 0;
 		virtual int close() = 0;
-		virtual int sendBuffer(const Buffer& buffer) = 0;
-		virtual int receiveBuffer(Buffer& buffer) = 0;
+		/** Thread-safe: wakes the blocked call, which returns ERROR_CANCELLED like every later one. */
+		virtual void cancel() = 0;
+		/**
+		 * With flow control the buffer is queued until the peer has room for it, the call blocks only while
+		 * the send queue is over its high-water mark. The rvalue overload queues the buffer without copying it.
+		 * The channel is used only if channels are enabled on both ends, see enableChannels.
+		 */
+		virtual int sendBuffer(const Buffer& buffer, unsigned char channel = Protocol::Channel::Normal, const Deadline& deadline = Deadline()) = 0;
+		virtual int sendBuffer(Buffer&& buffer, unsigned char channel = Protocol::Channel::Normal, const Deadline& deadline = Deadline()) = 0;
+		/** Like sendBuffer, but returns WSAEWOULDBLOCK instead of blocking when the send queue is full. */
+		virtual int trySendBuffer(const Buffer& buffer, unsigned char channel = Protocol::Channel::Normal) = 0;
+		/** Sends queued frames and reads the received ones (e.g. credits) as far as possible without blocking. */
+		virtual int pump() = 0;
+		/**
+		 * Receives the next buffer of the channel, Channel::Any takes the highest priority one that arrived.
+		 * Reuses the memory of buffer when it is large enough, so a buffer kept across calls does not reallocate.
+		 */
+		virtual int receiveBuffer(Buffer& buffer, unsigned char channel = Protocol::Channel::Any, const Deadline& deadline = Deadline()) = 0;
+		/** Like receiveBuffer, but returns WSAEWOULDBLOCK instead of waiting when no frame has arrived. */
+		virtual int tryReceiveBuffer(Buffer& buffer, unsigned char channel = Protocol::Channel::Any) = 0;
+		/** Bytes of the frames waiting in the send queue for credits or for room in the socket. */
+		virtual size_t getQueuedBytes() const = 0;
+		/** The numeric address of the other end, empty if not connected. */
+		virtual std::string getPeerAddress() const = 0;
+
+		/**
+		 * Sends the file region as a buffer, the bytes go from the file cache to the socket without being copied.
+		 * The region is not sliced: it waits for the queued frames and arrives on the Normal channel.
+		 */
+		virtual int sendFileRegion(const FileRegion& region) = 0;
+		/** Receives a buffer directly into a memory-mapped file at path, the returned buffer is backed by the file. */
+		virtual int receiveBufferToFile(const std::string& path, Buffer& buffer) = 0;
+
+		/**
+		 * Asks for a CRC32C after every header and every frame, bad frames are then rejected with ERROR_CRC.
+		 * Must be called before connect, it is used only if the other end asks for it too.
+		 */
+		virtual void enableIntegrityCheck() = 0;
+		/**
+		 * Credit-based flow control: the peer may send at most receiveWindow frames ahead of receiveBuffer, and
+		 * frames waiting for credits are queued up to sendQueueLimit bytes. Same rules as enableIntegrityCheck.
+		 */
+		virtual void enableFlowControl(size_t receiveWindow = Protocol::defaultReceiveWindow, size_t sendQueueLimit = Protocol::defaultSendQueueLimit) = 0;
+		/**
+		 * Prioritized logical channels, see Protocol::Channel: frames are sent in slices of at most sliceSize bytes,
+		 * so a frame of a higher priority channel does not wait for a large one to end. Enables flow control too.
+		 */
+		virtual void enableChannels(size_t sliceSize = Protocol::defaultSliceSize) = 0;
+		/**
+		 * Lets several threads call sendBuffer and trySendBuffer at once, also while another thread receives.
+		 * A sender queues its frame without a lock, the thread that holds the connection at that moment writes it.
+		 * Enables flow control too, connect fails with ERROR_NOT_SUPPORTED if the other end does not use it.
+		 */
+		virtual void enableConcurrentSends() = 0;
+		/** Frames larger than maxFrameSize bytes are rejected with ERROR_INVALID_DATA before any memory is allocated for them. */
+		virtual void setMaxFrameSize(size_t maxFrameSize) = 0;
+		/**
+		 * Records the frames the application sends and receives, with the time of each, in a new file at path, see
+		 * TrafficCapture; the Replay tool plays them back. The Hello messages and the file regions are not recorded.
+		 */
+		virtual int enableCapture(const std::string& path) = 0;
 	};
 }
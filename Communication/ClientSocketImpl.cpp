@@ -1,6 +1,13 @@
 #include "ClientSocketImpl.hpp"
 #include "Exports.hpp"
+#include "FileRegion.hpp"
 #include "ScopeGuard.hpp"
+#include <mswsock.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
 
 
 COMMUNICATION_TAG Communication::ClientSocket* CreateClientSocket()
@@ -13,6 +20,11 @@ COMMUNICATION_TAG void DeleteClientSocket(Communication::ClientSocket* sock)
 	delete sock;
 }
 
+COMMUNICATION_TAG int WaitForInput(Communication::ClientSocket* const* sockets, size_t count, int timeout)
+{
+	return Communication::ClientSocketImpl::waitForInput(sockets, count, timeout);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -21,6 +33,98 @@ COMMUNICATION_TAG void DeleteClientSocket(Communication::ClientSocket* sock)
 
 namespace Communication
 {
+	/** Largest transfer done by a single send, recv or TransmitFile call. */
+	constexpr size_t maxTransferSize = size_t(1) << 30;
+	/** Bytes sent at once when a CRC is computed, small enough to still be in the cache when the CRC reads them. */
+	constexpr size_t crcBlockSize = 64 * 1024;
+	/** A batch stops growing at about this many bytes, unless a slice is smaller. */
+	constexpr size_t maxBatchBytes = 64 * 1024;
+	/** How long close waits for the queued frames to go out. */
+	constexpr std::chrono::milliseconds closeTimeout(5000);
+
+	static void writeTrailer(uint32_t crc, unsigned char* trailer)
+	{
+		for (size_t i = 0; i < 4; i++)
+			trailer[i] = static_cast<unsigned char>(crc >> (8 * i));
+	}
+
+	static uint32_t readTrailer(const unsigned char* trailer)
+	{
+		uint32_t crc = 0;
+		for (size_t i = 0; i < 4; i++)
+			crc |= uint32_t(trailer[i]) << (8 * i);
+		return crc;
+	}
+
+	/** Writes the CRC of the header right after it, returns the size of both. */
+	static size_t appendHeaderCrc(unsigned char* header, size_t headerSize)
+	{
+		Crc32c crc;
+		crc.update(header, headerSize);
+		writeTrailer(crc.value(), header + headerSize);
+		return headerSize + 4;
+	}
+
+	/** Reads the header of the buffer at the start of the region. */
+	static int readRegionHeader(const FileRegion& region, unsigned char* header, size_t& headerSize)
+	{
+		OVERLAPPED position = {};
+		position.Offset = DWORD(region.getOffset() & 0xFFFFFFFF);
+		position.OffsetHigh = DWORD(region.getOffset() >> 32);
+		DWORD read = 0;
+		if (!ReadFile(region.getFile(), header, DWORD(std::min<unsigned long long>(region.getLength(), Buffer::maxHeaderSize)), &read, &position))
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut citi header-ul bufferului din fisier, error = ", error);
+			return error;
+		}
+		Buffer::BufferType type;
+		size_t dataSize = 0;
+		headerSize = Buffer::readHeader(header, read, type, dataSize);
+		if (headerSize == 0)
+		{
+			_log_("Fisierul nu incepe cu header-ul unui buffer.");
+			return ERROR_INVALID_DATA;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	static void unmapFileView(void* view)
+	{
+		UnmapViewOfFile(view);
+	}
+
+	/** Creates the file with size bytes and maps it in memory, the view is released by unmapFileView. */
+	static int mapFile(const std::string& path, unsigned long long size, void*& view)
+	{
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut crea fisierul \"", path, "\", error = ", error);
+			return error;
+		}
+		ScopeGuard closeFile([file] { CloseHandle(file); });
+
+		// The mapping extends the file to its final size
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size & 0xFFFFFFFF), nullptr);
+		if (mapping == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut mapa fisierul \"", path, "\" de ", size, " bytes, error = ", error);
+			return error;
+		}
+		view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		CloseHandle(mapping);		// The view keeps the mapping alive
+		if (view == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut mapa in memorie fisierul \"", path, "\", error = ", error);
+			return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
 	ClientSocketImpl::ClientSocketImpl()
 	{
 		ZeroMemory(&hints, sizeof(hints));
@@ -42,7 +146,7 @@ namespace Communication
 		close();
 	}
 	
-	int ClientSocketImpl::connect(const std::string& hostname, int port)
+	int ClientSocketImpl::connect(const std::string& hostname, int port, const Deadline& deadline)
 	{
 		if (socket != INVALID_SOCKET)
 		{
@@ -57,6 +161,8 @@ namespace Communication
 		}
 		ScopeGuard freeInfo([this] { freeaddrinfo(result); });
 
+		if (int error = createWakeSocket(wakeSocket); error)
+			return error;
 		socket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
 		if (socket == INVALID_SOCKET)
 		{
@@ -64,89 +170,1416 @@ namespace Communication
 			_log_("Nu s-a putut crea socketul, error = ", error);
 			return error;
 		}
+		enableLoopbackFastPath(socket);
+		if (int error = startOperation(deadline); error)
+			return error;
+		if (int error = setBlocking(false); error)
+			return error;
 
+		// The connection is established in the background, the socket becomes writable when it is done
 		if (int error = ::connect(socket, result->ai_addr, int(result->ai_addrlen)); error == SOCKET_ERROR)
 		{
 			error = WSAGetLastError();
-			_log_("Nu s-a reusit conectarea la ", result->ai_addr->sa_data, ", error = ", error);
+			if (error == WSAEWOULDBLOCK)
+			{
+				short ready = 0;
+				do
+					error = poll(POLLWRNORM, ready);
+				while (error == ERROR_SUCCESS && ready == 0);
+				int length = sizeof(error);
+				if (error == ERROR_SUCCESS && getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &length) == SOCKET_ERROR)
+					error = WSAGetLastError();
+			}
+			if (error != ERROR_SUCCESS)
+			{
+				_log_("Nu s-a reusit conectarea la ", result->ai_addr->sa_data, ", error = ", error);
+				return error;
+			}
+		}
+		return handshake(deadline);
+	}
+
+	int ClientSocketImpl::handshake(const Deadline& deadline)
+	{
+		// Accepted sockets get their wake socket here
+		if (wakeSocket == INVALID_SOCKET)
+			if (int error = createWakeSocket(wakeSocket); error)
+				return error;
+		if (int error = startOperation(deadline); error)
+			return error;
+
+		// Waits go through WSAPoll, so a blocked transfer can still send the queued frames and can end at the deadline
+		if (int error = setBlocking(false); error)
+			return error;
+
+		// Both ends send first, the message is small enough not to block
+		unsigned char hello[Protocol::helloSize];
+		Protocol::writeHello(hello, requestedFeatures);
+		if (int error = sendAll(hello, sizeof(hello)); error)
+			return error;
+		if (int error = receiveAll(hello, sizeof(hello)); error)
 			return error;
+
+		unsigned char peerVersion, peerFeatures;
+		if (!Protocol::readHello(hello, peerVersion, peerFeatures))
+		{
+			_log_("Capatul celalalt al conexiunii nu foloseste acest protocol.");
+			return ERROR_INVALID_DATA;
 		}
+		if (peerVersion < Protocol::minimumVersion)
+		{
+			_log_("Versiunea ", int(peerVersion), " a protocolului nu este suportata, minimul este ", int(Protocol::minimumVersion), ".");
+			return ERROR_REVISION_MISMATCH;
+		}
+		features = Protocol::supportedFeatures & requestedFeatures & peerFeatures;
+		if ((features & Protocol::Feature::FlowControl) == 0)
+			features &= ~Protocol::Feature::Channels;
+		if (concurrentSends && !isFlowControlled())
+		{
+			_log_("Trimiterea concurenta are nevoie de controlul fluxului, pe care capatul celalalt nu il foloseste.");
+			return ERROR_NOT_SUPPORTED;
+		}
+
+		// The peer may send nothing until it gets the first credits
+		if (!isFlowControlled())
+			return ERROR_SUCCESS;
+		enqueueControl(Protocol::Control::Credit, receiveWindow);
+		return flushQueues();
+	}
+
+	void ClientSocketImpl::enableIntegrityCheck()
+	{
+		requestedFeatures |= Protocol::Feature::Crc32c;
+	}
+
+	void ClientSocketImpl::enableFlowControl(size_t receiveWindow, size_t sendQueueLimit)
+	{
+		requestedFeatures |= Protocol::Feature::FlowControl;
+		this->receiveWindow = std::max<size_t>(receiveWindow, 1);
+		this->sendQueueLimit = sendQueueLimit;
+	}
+
+	void ClientSocketImpl::enableChannels(size_t sliceSize)
+	{
+		requestedFeatures |= Protocol::Feature::Channels | Protocol::Feature::FlowControl;
+		this->sliceSize = std::max(sliceSize, Protocol::minimumSliceSize);
+	}
+
+	void ClientSocketImpl::enableConcurrentSends()
+	{
+		requestedFeatures |= Protocol::Feature::FlowControl;
+		concurrentSends = true;
+	}
+
+	void ClientSocketImpl::setMaxFrameSize(size_t maxFrameSize)
+	{
+		this->maxFrameSize = maxFrameSize;
+	}
+
+	int ClientSocketImpl::enableCapture(const std::string& path)
+	{
+		std::unique_ptr<TrafficCapture> opened(new TrafficCapture());
+		if (int error = opened->open(path); error)
+			return error;
+		capture = std::move(opened);
 		return ERROR_SUCCESS;
 	}
 
 	int ClientSocketImpl::close()
 	{
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+
+		// The queued frames are sent first, unless the connection fails, is cancelled or the peer stops reading
+		collectPending();
+		if (socket != INVALID_SOCKET && isFlowControlled() && startOperation(Deadline::after(closeTimeout)) == ERROR_SUCCESS)
+			while (hasQueued())
+				if (progress() != ERROR_SUCCESS)
+					break;
+		if (socket != INVALID_SOCKET)
+			awaitTransmitted(Deadline::after(closeTimeout));
+
+		for (size_t channel = 0; channel < Protocol::channelCount; channel++)
+		{
+			sendQueues[channel].clear();
+			inboxes[channel].clear();
+			reassemblies[channel].received = 0;
+		}
+		controlQueue.clear();
+		batchSize = 0;
+		PendingFrame pending;
+		while (pendingFrames.pop(pending))
+			pendingCount--;
+		queuedBytes = 0;
+		inboxFrames = sendCredits = consumedFrames = 0;
+		cacheBegin = cacheEnd = 0;
+		failure = ERROR_SUCCESS;
+		cancelled = false;
+		if (wakeSocket != INVALID_SOCKET)
+			::closesocket(wakeSocket);
+		wakeSocket = INVALID_SOCKET;
+		const int error = _close(socket);
 		socket = INVALID_SOCKET;
-		return _close(socket);
+		closed();
+		return error;
 	}
 
-	int ClientSocketImpl::sendBuffer(const Buffer& buffer)
+	std::string ClientSocketImpl::getPeerAddress() const
+	{
+		sockaddr_in address = {};
+		int length = sizeof(address);
+		char text[INET_ADDRSTRLEN] = "";
+		if (socket == INVALID_SOCKET
+			|| getpeername(socket, reinterpret_cast<sockaddr *>(&address), &length) == SOCKET_ERROR
+			|| inet_ntop(AF_INET, &address.sin_addr, text, sizeof(text)) == nullptr)
+			return "";
+		return text;
+	}
+
+	void ClientSocketImpl::cancel()
+	{
+		cancelled = true;
+		wake(wakeSocket);
+		signalHoldChanged();
+	}
+
+	int ClientSocketImpl::startOperation(const Deadline& deadline)
+	{
+		if (cancelled)
+			return ERROR_CANCELLED;
+		if (failure != ERROR_SUCCESS)
+		{
+			_log_("Conexiunea nu mai poate fi folosita, un frame a fost intrerupt de expirarea timpului.");
+			return failure;
+		}
+		this->deadline = deadline;
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::frameCut(int error)
+	{
+		if (error == WSAETIMEDOUT)
+			failure = error;
+		return error;
+	}
+
+	void ClientSocketImpl::hold()
+	{
+		if (!concurrentSends)
+			return;
+		// Senders hold the connection only to write what the socket takes without blocking, or for one wait
+		if (tryHold())
+			return;
+		std::unique_lock<std::mutex> lock(holdMutex);
+		holdChanged.wait(lock, [this] { return tryHold(); });
+	}
+
+	bool ClientSocketImpl::tryHold()
+	{
+		return !holding.exchange(true);
+	}
+
+	void ClientSocketImpl::release()
+	{
+		if (!concurrentSends)
+			return;
+		holding = false;
+		signalHoldChanged();
+
+		// A sender that found the connection held counts on the holder for its frame, so the check follows
+		// the release: either it is seen here, or the sender takes the connection after the release
+		while (pendingCount > 0 && tryHold())
+		{
+			collectPending();
+			flushQueues();		// An error shows up again in the next operation
+			holding = false;
+			signalHoldChanged();
+		}
+	}
+
+	void ClientSocketImpl::signalHoldChanged()
+	{
+		{
+			std::lock_guard<std::mutex> guard(holdMutex);
+		}
+		holdChanged.notify_all();
+	}
+
+	void ClientSocketImpl::awaitHoldChanged(const Deadline& deadline)
+	{
+		std::unique_lock<std::mutex> lock(holdMutex);
+		auto changed = [this] { return cancelled || !holding || queuedBytes < sendQueueLimit; };
+		if (deadline.isInfinite())
+			holdChanged.wait(lock, changed);
+		else
+			holdChanged.wait_for(lock, std::chrono::milliseconds(deadline.getRemainingMilliseconds()), changed);
+	}
+
+	int ClientSocketImpl::sendConcurrently(Buffer&& buffer, unsigned char channel, const Deadline& deadline, bool wait)
+	{
+		// Over the high-water mark the sender waits for the holder of the connection, or moves it forward itself
+		while (queuedBytes >= sendQueueLimit)
+		{
+			if (!wait)
+				return WSAEWOULDBLOCK;
+			if (!tryHold())
+			{
+				if (cancelled)
+					return ERROR_CANCELLED;
+				if (deadline.hasExpired())
+				{
+					_log_("Timpul alocat operatiei a expirat.");
+					return WSAETIMEDOUT;
+				}
+				awaitHoldChanged(deadline);
+				continue;
+			}
+			int error = startOperation(deadline);
+			if (error == ERROR_SUCCESS)
+			{
+				collectPending();
+				error = progress();
+			}
+			release();
+			if (error)
+				return error;
+		}
+
+		captured(TrafficCapture::Direction::Sent, channel, buffer);
+		PendingFrame pending;
+		pending.buffer = std::move(buffer);
+		pending.channel = channel;
+		queuedBytes += pending.buffer.getSize();
+		pendingFrames.push(std::move(pending));
+		pendingCount++;
+
+		// The holder writes the frame, woken if it waits in WSAPoll; if there is none, this thread writes it
+		if (!tryHold())
+		{
+			wake(wakeSocket);
+			return ERROR_SUCCESS;
+		}
+		collectPending();
+		int error = flushQueues();
+		release();
+		return error;
+	}
+
+	void ClientSocketImpl::collectPending()
+	{
+		PendingFrame pending;
+		while (pendingFrames.pop(pending))
+		{
+			pendingCount--;
+			OutgoingFrame frame;
+			frame.buffer = std::move(pending.buffer);
+			sendQueues[channelIndex(pending.channel)].push_back(std::move(frame));
+		}
+	}
+
+	int ClientSocketImpl::sendBuffer(const Buffer& buffer, unsigned char channel, const Deadline& deadline)
 	{
 		if (socket == INVALID_SOCKET)
 		{
 			_log_("Socket-ul nu este valid pentru trimitere de date.");
 			return ERROR_INVALID_HANDLE;
 		}
+		if (channel >= Protocol::channelCount)
+		{
+			_log_("Canalul ", int(channel), " nu exista.");
+			return ERROR_INVALID_PARAMETER;
+		}
+		if (concurrentSends)
+			return sendConcurrently(Buffer(buffer), channel, deadline, true);
+		if (int error = startOperation(deadline); error)
+			return error;
+		if (!isFlowControlled())
+			return sendFrame(buffer);
+		if (int error = waitForQueueSpace(true); error)
+			return error;
+		return enqueue(Buffer(buffer), channel);
+	}
 
+	int ClientSocketImpl::sendBuffer(Buffer&& buffer, unsigned char channel, const Deadline& deadline)
+	{
+		if (socket == INVALID_SOCKET)
+		{
+			_log_("Socket-ul nu este valid pentru trimitere de date.");
+			return ERROR_INVALID_HANDLE;
+		}
+		if (channel >= Protocol::channelCount)
+		{
+			_log_("Canalul ", int(channel), " nu exista.");
+			return ERROR_INVALID_PARAMETER;
+		}
+		// The bytes of a view may be released after the call, so they are copied
+		if (concurrentSends)
+			return sendConcurrently(buffer.isView() ? Buffer(buffer) : std::move(buffer), channel, deadline, true);
+		if (int error = startOperation(deadline); error)
+			return error;
+		if (!isFlowControlled())
+			return sendFrame(buffer);
+		if (int error = waitForQueueSpace(true); error)
+			return error;
+		return enqueue(buffer.isView() ? Buffer(buffer) : std::move(buffer), channel);
+	}
 
-		int ret = send(socket, static_cast<const char*>(buffer.operator const void *()), int(buffer.getSize()), 0);
-		if (ret == SOCKET_ERROR)
+	int ClientSocketImpl::trySendBuffer(const Buffer& buffer, unsigned char channel)
+	{
+		if (socket == INVALID_SOCKET)
 		{
-			ret = WSAGetLastError();
-			_log_("Nu s-a reusit trimiterea de ", buffer.getSize(), " bytes la ", result->ai_addr, ", error = ", ret);
-			return ret;
+			_log_("Socket-ul nu este valid pentru trimitere de date.");
+			return ERROR_INVALID_HANDLE;
 		}
-		return ERROR_SUCCESS;
+		if (channel >= Protocol::channelCount)
+		{
+			_log_("Canalul ", int(channel), " nu exista.");
+			return ERROR_INVALID_PARAMETER;
+		}
+		if (concurrentSends)
+			return sendConcurrently(Buffer(buffer), channel, Deadline(), false);
+		if (int error = startOperation(Deadline()); error)
+			return error;
+		if (!isFlowControlled())
+			return sendFrame(buffer);
+		if (int error = waitForQueueSpace(false); error)
+			return error;
+		return enqueue(Buffer(buffer), channel);
 	}
 
-	int ClientSocketImpl::receiveBuffer(Buffer& buffer)
+	int ClientSocketImpl::pump()
 	{
 		if (socket == INVALID_SOCKET)
 		{
-			_log_("Socket-ul nu este valid pentru primire de date.");
+			_log_("Socket-ul nu este valid.");
 			return ERROR_INVALID_HANDLE;
 		}
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+		if (int error = startOperation(Deadline()); error)
+			return error;
+		return pumpQueues();
+	}
 
+	int ClientSocketImpl::pumpQueues()
+	{
+		if (!isFlowControlled())
+			return ERROR_SUCCESS;
 
-		constexpr int tempBufferSize = 512;
-		char received[tempBufferSize];
-		std::vector<std::vector<char>> tempBuffers;
+		collectPending();
+		for (;;)
+		{
+			if (int error = flushQueues(); error)
+				return error;
+			if (!hasInput())
+				return ERROR_SUCCESS;
+			if (int error = receiveNext(); error)
+				return error;
+		}
+	}
 
-		// Read parts of the full buffer
-		int ret = recv(socket, received, tempBufferSize, 0);
-		while (ret && ret != SOCKET_ERROR)
+	int ClientSocketImpl::receiveBuffer(Buffer& buffer, unsigned char channel, const Deadline& deadline)
+	{
+		if (socket == INVALID_SOCKET)
 		{
-			if (ret < tempBufferSize)
-				break;
+			_log_("Socket-ul nu este valid pentru primire de date.");
+			return ERROR_INVALID_HANDLE;
+		}
+		if (channel >= Protocol::channelCount && channel != Protocol::Channel::Any)
+		{
+			_log_("Canalul ", int(channel), " nu exista.");
+			return ERROR_INVALID_PARAMETER;
+		}
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+		if (int error = startOperation(deadline); error)
+			return error;
+		if (!isFlowControlled())
+			return receiveFrame(buffer);
+		return receiveQueued(buffer, channel);
+	}
+
+	int ClientSocketImpl::receiveQueued(Buffer& buffer, unsigned char channel)
+	{
+		while (!takeReceived(buffer, channel))
+			if (int error = receiveNext(); error)
+				return error;
+		return frameConsumed();
+	}
+
+	int ClientSocketImpl::tryReceiveBuffer(Buffer& buffer, unsigned char channel)
+	{
+		if (socket == INVALID_SOCKET)
+		{
+			_log_("Socket-ul nu este valid pentru primire de date.");
+			return ERROR_INVALID_HANDLE;
+		}
+		if (channel >= Protocol::channelCount && channel != Protocol::Channel::Any)
+		{
+			_log_("Canalul ", int(channel), " nu exista.");
+			return ERROR_INVALID_PARAMETER;
+		}
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+		if (int error = startOperation(Deadline()); error)
+			return error;
+		if (!isFlowControlled())
+			return hasInput() ? receiveFrame(buffer) : WSAEWOULDBLOCK;
+
+		// Everything that arrived goes to the inboxes first, control frames included
+		if (int error = pumpQueues(); error)
+			return error;
+		if (!takeReceived(buffer, channel))
+			return WSAEWOULDBLOCK;
+		return frameConsumed();
+	}
 
-			tempBuffers.push_back(std::vector<char>(tempBufferSize));
-			std::memcpy(&tempBuffers.back()[0], received, tempBufferSize);
-			ret = recv(socket, received, tempBufferSize, 0);
+	int ClientSocketImpl::sendFrame(const Buffer& buffer)
+	{
+		captured(TrafficCapture::Direction::Sent, Protocol::Channel::Normal, buffer);
+		const bool checked = isChecked();
+		Crc32c crc;
+		const char* bytes = static_cast<const char *>(static_cast<const void *>(buffer));
+		size_t headerSize = 0;
+		if (checked)		// The CRC of the header goes between the header and the data
+		{
+			unsigned char header[Buffer::maxHeaderSize + 4];
+			headerSize = buffer.getHeaderSize();
+			std::memcpy(header, bytes, headerSize);
+			crc.update(header, headerSize);
+			if (int error = sendAll(header, appendHeaderCrc(header, headerSize)); error)
+			{
+				_log_("Nu s-a reusit trimiterea header-ului bufferului, error = ", error);
+				return frameCut(error);
+			}
 		}
-		if (ret == SOCKET_ERROR)
+		if (int error = sendAll(bytes + headerSize, buffer.getSize() - headerSize, checked ? &crc : nullptr); error)
 		{
-			ret = WSAGetLastError();
-			_log_("Apelul recv a intors eroarea ", ret);
-			return ret;
+			_log_("Nu s-a reusit trimiterea bufferului de ", buffer.getSize(), " bytes, error = ", error);
+			return frameCut(error);
 		}
+		return checked ? frameCut(sendTrailer(crc)) : ERROR_SUCCESS;
+	}
 
-		// Merge the parts into the full buffer
-		const int fullBufferSize = int(tempBuffers.size()) * tempBufferSize + ret;
-		char* fullBuffer = static_cast<char *>(std::malloc(fullBufferSize));
+	int ClientSocketImpl::receiveFrame(Buffer& buffer)
+	{
+		unsigned char header[Buffer::maxHeaderSize];
+		size_t headerSize, dataSize;
+		Buffer::BufferType type;
+		if (int error = receiveHeader(header, headerSize, type, dataSize); error)
+			return error;
+		if (int error = receivePayload(header, headerSize, dataSize, buffer); error)
+			return frameCut(error);
+		captured(TrafficCapture::Direction::Received, Protocol::Channel::Normal, buffer);
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receivePayload(const unsigned char* header, size_t headerSize, size_t dataSize, Buffer& buffer)
+	{
+		// The header gives the exact size of the buffer, checked by receiveHeader, so it is received in place,
+		// in the memory of the given buffer when that is large enough
+		const size_t fullBufferSize = headerSize + dataSize;
+		char* fullBuffer = static_cast<char *>(buffer.getStorage(fullBufferSize));
 		if (fullBuffer == nullptr)
 		{
 			_log_("Nu s-a putut aloca o zona de memorie de ", fullBufferSize, " pentru a putea stoca buffer-ul.");
 			return ERROR_OUTOFMEMORY;
 		}
-		int offset = 0;
-		for (auto& vec : tempBuffers)
+
+		if (int error = receiveInto(fullBuffer, header, headerSize, dataSize); error)
+			return error;
+		buffer.adoptStorage();
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveInto(char* bytes, const unsigned char* header, size_t headerSize, size_t dataSize)
+	{
+		// The CRC is computed while the bytes arrive, the frame is checked before it is used
+		const bool checked = isChecked();
+		Crc32c crc;
+		crc.update(header, headerSize);
+		std::memcpy(bytes, header, headerSize);
+		if (int error = receiveAll(bytes + headerSize, dataSize, checked ? &crc : nullptr); error)
+			return error;
+		return checked ? checkTrailer(crc) : ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveFileFrame(const unsigned char* header, size_t headerSize, size_t dataSize)
+	{
+		void* view = nullptr;
+		if (int error = mapFile(*filePath, (unsigned long long)headerSize + dataSize, view); error)
+			return error;
+		ScopeGuard unmapView([view] { UnmapViewOfFile(view); });
+		if (int error = receiveInto(static_cast<char *>(view), header, headerSize, dataSize); error)
+			return error;
+		unmapView.cancel();
+		filePath = nullptr;
+		fileChannel = Protocol::Channel::Normal;
+		return deliver(Protocol::Channel::Normal, Buffer(std::move(view), unmapFileView));
+	}
+
+	int ClientSocketImpl::waitForQueueSpace(bool wait)
+	{
+		if (int error = pumpQueues(); error)
+			return error;
+		while (queuedBytes >= sendQueueLimit)
+		{
+			if (!wait)
+				return WSAEWOULDBLOCK;
+			if (int error = progress(); error)
+				return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::enqueue(Buffer&& buffer, unsigned char channel)
+	{
+		captured(TrafficCapture::Direction::Sent, channel, buffer);
+		OutgoingFrame frame;
+		frame.buffer = std::move(buffer);
+		queuedBytes += frame.buffer.getSize();
+		sendQueues[channelIndex(channel)].push_back(std::move(frame));
+		return flushQueues();
+	}
+
+	void ClientSocketImpl::enqueueControl(Protocol::Control kind, uint64_t value)
+	{
+		unsigned char data[Protocol::maxControlSize];
+		data[0] = static_cast<unsigned char>(kind);
+		const size_t dataSize = 1 + Varint::encode(value, data + 1);
+
+		OutgoingFrame frame;
+		char* bytes = static_cast<char *>(frame.buffer.getStorage(Buffer::getHeaderSize(dataSize) + dataSize));
+		assert(bytes != nullptr, "Eroare la alocare memorie pentru un frame de control.");
+		const size_t headerSize = Buffer::writeHeader(bytes, Buffer::BufferType::Control, dataSize);
+		std::memcpy(bytes + headerSize, data, dataSize);
+		frame.buffer.adoptStorage();
+		controlQueue.push_back(std::move(frame));
+	}
+
+	ClientSocketImpl::OutgoingFrame* ClientSocketImpl::nextFrame(std::deque<OutgoingFrame>& queue)
+	{
+		// Only the frames in the batch are before it, so the search is short
+		for (OutgoingFrame& frame : queue)
+			if (frame.sliced < frame.buffer.getSize())
+				return &frame;
+		return nullptr;
+	}
+
+	bool ClientSocketImpl::canSend()
+	{
+		if (batchSize > 0 || nextFrame(controlQueue) != nullptr)
+			return true;
+		for (std::deque<OutgoingFrame>& queue : sendQueues)
+			if (OutgoingFrame* frame = nextFrame(queue); frame != nullptr && (frame->sliced > 0 || sendCredits > 0))
+				return true;
+		return false;
+	}
+
+	bool ClientSocketImpl::hasQueued() const
+	{
+		if (batchSize > 0 || !controlQueue.empty() || pendingCount > 0)
+			return true;
+		for (const std::deque<OutgoingFrame>& queue : sendQueues)
+			if (!queue.empty())
+				return true;
+		return false;
+	}
+
+	int ClientSocketImpl::flushQueues()
+	{
+		const size_t batchLimit = (features & Protocol::Feature::Channels) != 0 ? std::min(sliceSize, maxBatchBytes) : maxBatchBytes;
+		for (;;)
+		{
+			// Small frames and slices go out together, but a batch holds back a higher priority frame for little
+			size_t batchBytes = 0;
+			for (size_t i = 0; i < batchSize; i++)
+			{
+				const Transmission& transmission = batch[(batchBegin + i) % maxBatchSize];
+				batchBytes += transmission.getSize() - transmission.sent;
+			}
+			while (batchSize < maxBatchSize && (batchSize == 0 || batchBytes < batchLimit))
+			{
+				Transmission& transmission = batch[(batchBegin + batchSize) % maxBatchSize];
+				if (!startTransmission(transmission))
+					break;
+				batchBytes += transmission.getSize();
+				batchSize++;
+			}
+			if (batchSize == 0)
+				return ERROR_SUCCESS;
+
+			// The prefix, body and trailer of every transmission are the buffers of one vectored write
+			WSABUF buffers[3 * maxBatchSize];
+			DWORD bufferCount = 0;
+			size_t requested = 0;
+			for (size_t i = 0; i < batchSize && requested < maxTransferSize; i++)
+			{
+				const Transmission& transmission = batch[(batchBegin + i) % maxBatchSize];
+				const char* pieces[] = { reinterpret_cast<const char *>(transmission.prefix), transmission.body, reinterpret_cast<const char *>(transmission.trailer) };
+				const size_t pieceSizes[] = { transmission.prefixSize, transmission.bodySize, transmission.trailerSize };
+				size_t skipped = transmission.sent;
+				for (size_t piece = 0; piece < 3 && requested < maxTransferSize; piece++)
+				{
+					if (skipped >= pieceSizes[piece])
+					{
+						skipped -= pieceSizes[piece];
+						continue;
+					}
+					const size_t length = std::min(pieceSizes[piece] - skipped, maxTransferSize - requested);
+					buffers[bufferCount].buf = const_cast<char *>(pieces[piece] + skipped);
+					buffers[bufferCount].len = ULONG(length);
+					bufferCount++;
+					requested += length;
+					skipped = 0;
+				}
+			}
+
+			size_t sent = 0;
+			if (int error = transmit(buffers, bufferCount, sent); error)
+			{
+				if (error == WSAEWOULDBLOCK)
+					return ERROR_SUCCESS;
+				_log_("Nu s-a reusit trimiterea frame-urilor din coada, error = ", error);
+				return error;
+			}
+
+			// A frame leaves its queue with its last slice
+			for (size_t written = sent; batchSize > 0; )
+			{
+				Transmission& transmission = batch[batchBegin];
+				const size_t left = transmission.getSize() - transmission.sent;
+				if (written < left)
+				{
+					transmission.sent += written;
+					break;
+				}
+				written -= left;
+				if (transmission.last)
+				{
+					if (transmission.queue != &controlQueue)
+					{
+						const size_t size = transmission.queue->front().buffer.getSize();
+						const size_t before = queuedBytes.fetch_sub(size);
+						if (concurrentSends && before >= sendQueueLimit && before - size < sendQueueLimit)
+							signalHoldChanged();		// For the senders waiting over the high-water mark
+					}
+					transmission.queue->pop_front();
+				}
+				batchBegin = (batchBegin + 1) % maxBatchSize;
+				batchSize--;
+			}
+			if (sent < requested)
+				return ERROR_SUCCESS;
+		}
+	}
+
+	bool ClientSocketImpl::startTransmission(Transmission& transmission)
+	{
+		// Control frames go between transmissions, a data frame starts only with a credit
+		std::deque<OutgoingFrame>* queue = nullptr;
+		OutgoingFrame* frame = nextFrame(controlQueue);
+		if (frame != nullptr)
+			queue = &controlQueue;
+		else
+			for (std::deque<OutgoingFrame>& channelQueue : sendQueues)
+				if ((frame = nextFrame(channelQueue)) != nullptr && (frame->sliced > 0 || sendCredits > 0))
+				{
+					queue = &channelQueue;
+					break;
+				}
+		if (queue == nullptr)
+			return false;
+
+		const size_t size = frame->buffer.getSize();
+		const char* bytes = static_cast<const char *>(static_cast<const void *>(frame->buffer));
+		if (queue != &controlQueue && frame->sliced == 0)
+			sendCredits--;
+
+		// The header on the wire, of the slice or of the whole frame, is in the prefix, followed by its CRC
+		transmission.queue = queue;
+		transmission.sent = 0;
+		const bool sliced = queue != &controlQueue && (features & Protocol::Feature::Channels) != 0;
+		size_t headerSize = 0;
+		if (sliced)
+		{
+			// The first slice holds only the header of the frame, the receiver checks it before it allocates the frame
+			const size_t pieceSize = frame->sliced == 0 ? frame->buffer.getHeaderSize() : std::min(size - frame->sliced, sliceSize);
+			headerSize = Buffer::writeHeader(transmission.prefix, Buffer::BufferType::Slice, 1 + pieceSize);
+			transmission.body = bytes + frame->sliced;
+			transmission.bodySize = pieceSize;
+			frame->sliced += pieceSize;
+		}
+		else
+		{
+			headerSize = frame->buffer.getHeaderSize();
+			std::memcpy(transmission.prefix, bytes, headerSize);
+			transmission.body = bytes + headerSize;
+			transmission.bodySize = size - headerSize;
+			frame->sliced = size;
+		}
+		transmission.last = frame->sliced == size;
+
+		const bool checked = isChecked();
+		transmission.prefixSize = checked ? appendHeaderCrc(transmission.prefix, headerSize) : headerSize;
+		if (sliced)
+			transmission.prefix[transmission.prefixSize++] = static_cast<unsigned char>(queue - sendQueues);
+		transmission.trailerSize = 0;
+		if (checked)
+		{
+			// The trailer covers the header and the data, not the CRC of the header
+			Crc32c crc;
+			crc.update(transmission.prefix, headerSize);
+			if (sliced)
+				crc.update(transmission.prefix + transmission.prefixSize - 1, 1);
+			crc.update(transmission.body, transmission.bodySize);
+			writeTrailer(crc.value(), transmission.trailer);
+			transmission.trailerSize = sizeof(transmission.trailer);
+		}
+		return true;
+	}
+
+	int ClientSocketImpl::progress()
+	{
+		if (cacheBegin == cacheEnd)
+		{
+			short ready = 0;
+			if (int error = poll(short(POLLRDNORM | (canSend() ? POLLWRNORM : 0)), ready); error)
+				return error;
+			if ((ready & (POLLRDNORM | POLLERR | POLLHUP | POLLNVAL)) == 0)
+				return flushQueues();
+		}
+
+		// Reading never waits for the application: the inboxes have room for everything the peer may send
+		return receiveNext();
+	}
+
+	int ClientSocketImpl::receiveNext()
+	{
+		unsigned char header[Buffer::maxHeaderSize];
+		size_t headerSize, dataSize;
+		Buffer::BufferType type;
+		if (int error = receiveHeader(header, headerSize, type, dataSize); error)
+			return error;
+
+		switch (type)
+		{
+		case Buffer::BufferType::Control:
+			if (dataSize > Protocol::maxControlSize)
+			{
+				_log_("Frame-ul de control primit nu este valid.");
+				return ERROR_INVALID_DATA;
+			}
+			if (int error = receivePayload(header, headerSize, dataSize, controlFrame); error)
+				return frameCut(error);
+			return applyControl(controlFrame);
+		case Buffer::BufferType::Slice:
+			return frameCut(receiveSlice(header, headerSize, dataSize));
+		default:
+			if (filePath != nullptr)
+				return frameCut(receiveFileFrame(header, headerSize, dataSize));
+			if (int error = receivePayload(header, headerSize, dataSize, recycled); error)
+				return frameCut(error);
+			return deliver(Protocol::Channel::Normal, std::move(recycled));
+		}
+	}
+
+	int ClientSocketImpl::receiveSlice(const unsigned char* header, size_t headerSize, size_t dataSize)
+	{
+		const bool checked = isChecked();
+		Crc32c crc;
+		crc.update(header, headerSize);
+		unsigned char channel = Protocol::channelCount;
+		if (dataSize > 0)
+			if (int error = receiveAll(&channel, 1, &crc); error)
+				return error;
+		if (channel >= Protocol::channelCount)
+		{
+			_log_("Slice-ul primit nu apartine niciunui canal.");
+			return ERROR_INVALID_DATA;
+		}
+		const size_t pieceSize = dataSize - 1;
+
+		// The first slice holds only the header of the frame, which gives the memory to reassemble it in;
+		// the header is checked, with the trailer of the slice, before the memory is allocated
+		Reassembly& reassembly = reassemblies[channel];
+		if (reassembly.received == 0)
 		{
-			std::memcpy(fullBuffer + offset, &vec[0], tempBufferSize);
-			offset += tempBufferSize;
+			unsigned char frameHeader[Buffer::maxHeaderSize];
+			const size_t frameHeaderSize = pieceSize;
+			size_t frameDataSize = 0;
+			Buffer::BufferType frameType;
+			if (frameHeaderSize > sizeof(frameHeader))
+			{
+				_log_("Primul slice al unui frame nu este valid.");
+				return ERROR_INVALID_DATA;
+			}
+			if (int error = receiveAll(frameHeader, frameHeaderSize, &crc); error)
+				return error;
+			if (checked)
+				if (int error = checkTrailer(crc); error)
+					return error;
+			if (Buffer::readHeader(frameHeader, frameHeaderSize, frameType, frameDataSize) != frameHeaderSize || frameHeaderSize == 0)
+			{
+				_log_("Primul slice al unui frame nu este valid.");
+				return ERROR_INVALID_DATA;
+			}
+			if (int error = checkFrameSize(frameHeaderSize, frameDataSize); error)
+				return error;
+
+			reassembly.size = frameHeaderSize + frameDataSize;
+			reassembly.inFile = filePath != nullptr;
+			if (reassembly.inFile)		// receiveBufferToFile waits for this frame, it is reassembled in the mapped file
+			{
+				void* view = nullptr;
+				if (int error = mapFile(*filePath, reassembly.size, view); error)
+					return error;
+				reassembly.bytes = static_cast<char *>(view);
+				std::memcpy(reassembly.bytes, frameHeader, frameHeaderSize);
+				reassembly.frame = Buffer(std::move(view), unmapFileView);
+				filePath = nullptr;
+				fileChannel = channel;
+			}
+			else
+			{
+				reassembly.frame = std::move(recycled);
+				reassembly.bytes = static_cast<char *>(reassembly.frame.getStorage(reassembly.size));
+				if (reassembly.bytes == nullptr)
+				{
+					_log_("Nu s-a putut aloca o zona de memorie de ", reassembly.size, " pentru a putea stoca buffer-ul.");
+					return ERROR_OUTOFMEMORY;
+				}
+				std::memcpy(reassembly.bytes, frameHeader, frameHeaderSize);
+			}
+			reassembly.received = frameHeaderSize;
 		}
-		std::memcpy(fullBuffer + offset, received, ret);	// Merge the last bit
+		else
+		{
+			if (pieceSize > reassembly.size - reassembly.received)
+			{
+				_log_("Slice-ul primit depaseste frame-ul din care face parte.");
+				return ERROR_INVALID_DATA;
+			}
+			if (int error = receiveAll(reassembly.bytes + reassembly.received, pieceSize, &crc); error)
+				return error;
+			if (checked)
+				if (int error = checkTrailer(crc); error)
+					return error;
+			reassembly.received += pieceSize;
+		}
+
+		if (reassembly.received < reassembly.size)
+			return ERROR_SUCCESS;
+		reassembly.received = 0;
+		if (!reassembly.inFile)		// The mapped buffer read its header when it was made
+			reassembly.frame.adoptStorage();
+		return deliver(channel, std::move(reassembly.frame));
+	}
 
-		buffer = Buffer(std::move(static_cast<void *>(fullBuffer)));
+	int ClientSocketImpl::deliver(size_t channel, Buffer&& frame)
+	{
+		if (inboxFrames >= receiveWindow)
+		{
+			_log_("Capatul celalalt a trimis mai multe frame-uri decat i s-au permis.");
+			return ERROR_INVALID_DATA;
+		}
+		inboxes[channel].push_back(std::move(frame));
+		inboxFrames++;
+		return ERROR_SUCCESS;
+	}
+
+	bool ClientSocketImpl::takeReceived(Buffer& buffer, unsigned char channel)
+	{
+		std::deque<Buffer>* inbox = nullptr;
+		if (channel == Protocol::Channel::Any)
+		{
+			for (std::deque<Buffer>& channelInbox : inboxes)
+				if (!channelInbox.empty())
+				{
+					inbox = &channelInbox;
+					break;
+				}
+		}
+		else if (!inboxes[channelIndex(channel)].empty())
+			inbox = &inboxes[channelIndex(channel)];
+		if (inbox == nullptr)
+			return false;
+		captured(TrafficCapture::Direction::Received, static_cast<unsigned char>(inbox - inboxes), inbox->front());
+
+		// The memory of the buffer given by the application receives the next frame
+		std::swap(buffer, inbox->front());
+		recycled = std::move(inbox->front());
+		inbox->pop_front();
+		inboxFrames--;
+		return true;
+	}
+
+	int ClientSocketImpl::applyControl(const Buffer& frame)
+	{
+		const unsigned char* data = static_cast<const unsigned char *>(frame.getData());
+		uint64_t value = 0;
+		if (frame.getDataSize() < 2 || Varint::decode(data + 1, frame.getDataSize() - 1, value) == 0)
+		{
+			_log_("Frame-ul de control primit nu este valid.");
+			return ERROR_INVALID_DATA;
+		}
+
+		switch (Protocol::Control(data[0]))
+		{
+		case Protocol::Control::Credit:
+			sendCredits += size_t(value);
+			return flushQueues();
+		}
+		_log_("Tipul ", int(data[0]), " de frame de control nu este cunoscut.");
+		return ERROR_INVALID_DATA;
+	}
+
+	int ClientSocketImpl::frameConsumed()
+	{
+		if (++consumedFrames < std::max<size_t>(receiveWindow / 2, 1))
+			return ERROR_SUCCESS;
+		enqueueControl(Protocol::Control::Credit, consumedFrames);
+		consumedFrames = 0;
+		return flushQueues();
+	}
+
+	bool ClientSocketImpl::hasInput()
+	{
+		return cacheBegin < cacheEnd || isReadable();
+	}
+
+	int ClientSocketImpl::transmit(WSABUF* buffers, DWORD bufferCount, size_t& sent)
+	{
+		DWORD transferred = 0;
+		if (WSASend(socket, buffers, bufferCount, &transferred, 0, nullptr, nullptr) == SOCKET_ERROR)
+			return WSAGetLastError();
+		sent = transferred;
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveSome(char* bytes, size_t capacity, size_t& received)
+	{
+		const int count = recv(socket, bytes, int(capacity), 0);
+		if (count == SOCKET_ERROR)
+			return WSAGetLastError();
+		received = size_t(count);
+		return ERROR_SUCCESS;
+	}
+
+	bool ClientSocketImpl::isReadable()
+	{
+		WSAPOLLFD descriptor = { socket, POLLRDNORM, 0 };
+		return WSAPoll(&descriptor, 1, 0) > 0;
+	}
+
+	int ClientSocketImpl::setBlocking(bool blocking)
+	{
+		u_long nonBlocking = blocking ? 0 : 1;
+		if (ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut schimba modul blocant al socket-ului, error = ", error);
+			return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::poll(short events, short& ready)
+	{
+		WSAPOLLFD descriptors[] = { { socket, events, 0 }, { wakeSocket, POLLRDNORM, 0 } };
+		const int count = WSAPoll(descriptors, wakeSocket != INVALID_SOCKET ? 2 : 1, deadline.getRemainingMilliseconds());
+		if (count == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Apelul WSAPoll a intors eroarea ", error);
+			return error;
+		}
+		if (cancelled)
+			return ERROR_CANCELLED;
+		if (count == 0)
+		{
+			_log_("Timpul alocat operatiei a expirat.");
+			return WSAETIMEDOUT;
+		}
+
+		// The wake socket alone woke the wait: concurrent senders queued frames, the caller writes them
+		ready = descriptors[0].revents;
+		if (ready == 0)
+		{
+			char drained[16];
+			while (recv(wakeSocket, drained, sizeof(drained), 0) > 0)
+				;
+			collectPending();
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::waitForInput(ClientSocket* const* sockets, size_t count, int timeout)
+	{
+		// Frames already in an inbox, or bytes already cached, need no wait
+		std::vector<ClientSocketImpl *> connections;
+		for (size_t i = 0; i < count; i++)
+		{
+			ClientSocketImpl* connection = static_cast<ClientSocketImpl *>(sockets[i]);
+			if (connection->socket == INVALID_SOCKET)
+				continue;
+			if (connection->inboxFrames > 0 || connection->hasInput())
+				return ERROR_SUCCESS;
+			connections.push_back(connection);
+		}
+		if (connections.empty())
+			return ERROR_SUCCESS;
+
+		// WSAPoll does not see the completions of Registered I/O, nor a completion queue those of another one
+		for (ClientSocketImpl* connection : connections)
+			if (connection->getPollGroup() != connections.front()->getPollGroup())
+			{
+				_log_("Conexiunile asteptate impreuna trebuie sa fie de acelasi tip si, cu Registered I/O, ale aceluiasi server.");
+				return ERROR_INVALID_PARAMETER;
+			}
+		return connections.front()->pollAny(connections, timeout);
+	}
+
+	int ClientSocketImpl::pollAny(const std::vector<ClientSocketImpl *>& connections, int timeout)
+	{
+		// The frames that wait for room in a socket are sent by the pump that follows, so a writable socket ends the wait too
+		std::vector<WSAPOLLFD> descriptors;
+		for (ClientSocketImpl* connection : connections)
+			descriptors.push_back({ connection->socket, short(POLLRDNORM | (connection->canSend() ? POLLWRNORM : 0)), 0 });
+		const int count = WSAPoll(descriptors.data(), ULONG(descriptors.size()), timeout);
+		if (count == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Apelul WSAPoll a intors eroarea ", error);
+			return error;
+		}
+		return count == 0 ? WSAETIMEDOUT : ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::waitFor(short events)
+	{
+		for (;;)
+		{
+			// While waiting for the peer, the queued frames go out as the socket takes them
+			const bool flush = (events & POLLRDNORM) != 0 && canSend();
+			short ready = 0;
+			if (int error = poll(short(events | (flush ? POLLWRNORM : 0)), ready); error)
+				return error;
+			// Errors are reported by the send or recv that follows
+			if (ready & (events | POLLERR | POLLHUP | POLLNVAL))
+				return ERROR_SUCCESS;
+			if (int error = flushQueues(); error)
+				return error;
+		}
+	}
+
+	int ClientSocketImpl::sendFileRegion(const FileRegion& region)
+	{
+		if (socket == INVALID_SOCKET)
+		{
+			_log_("Socket-ul nu este valid pentru trimitere de date.");
+			return ERROR_INVALID_HANDLE;
+		}
+		if (region.getFile() == INVALID_HANDLE_VALUE)
+		{
+			_log_("Regiunea de fisier nu este deschisa.");
+			return ERROR_INVALID_HANDLE;
+		}
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+		if (int error = startOperation(Deadline()); error)
+			return error;
+
+		// The region bypasses the send queues, so it waits for the queued frames and for a credit
+		if (isFlowControlled())
+		{
+			while (hasQueued() || sendCredits == 0)
+				if (int error = progress(); error)
+					return error;
+			sendCredits--;
+		}
+
+		// Raw values are preceded by the header of an Array buffer; the CRC of the header follows it, so the
+		// header of a region that holds a whole buffer is read from the file and sent apart
+		const bool checked = isChecked();
+		Crc32c crc;
+		unsigned char header[Buffer::maxHeaderSize + 4 + 1];
+		size_t headerSize = 0, skipped = 0;
+		if (!region.hasHeader())
+			headerSize = Buffer::writeHeader(header, Buffer::BufferType::Array, 1 + size_t(region.getLength()));
+		else if (checked)
+		{
+			if (int error = readRegionHeader(region, header, headerSize); error)
+				return error;
+			skipped = headerSize;
+		}
+		size_t sentSize = checked ? appendHeaderCrc(header, headerSize) : headerSize;
+		if (!region.hasHeader())
+			header[sentSize++] = static_cast<unsigned char>(region.getElementType());
+		if (checked)
+		{
+			if (!region.hasHeader())		// Else the header is part of the region
+			{
+				crc.update(header, headerSize);
+				crc.update(header + sentSize - 1, 1);
+			}
+			if (int error = checksumFileRegion(region, crc); error)
+				return error;
+		}
+		if (int error = sendAll(header, sentSize); error)
+			return error;
+		if (int error = transmitFile(region, skipped); error)
+			return error;
+		return checked ? sendTrailer(crc) : ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::transmitFile(const FileRegion& region, unsigned long long skipped)
+	{
+		// TransmitFile needs a blocking socket
+		if (int error = setBlocking(true); error)
+			return error;
+		ScopeGuard restoreMode([this] { setBlocking(false); });
+		for (unsigned long long sent = skipped; sent < region.getLength(); )
+		{
+			const DWORD chunkSize = DWORD(std::min<unsigned long long>(region.getLength() - sent, maxTransferSize));
+			LARGE_INTEGER position;
+			position.QuadPart = LONGLONG(region.getOffset() + sent);
+			if (!SetFilePointerEx(region.getFile(), position, nullptr, FILE_BEGIN))
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut pozitiona fisierul la ", position.QuadPart, ", error = ", error);
+				return error;
+			}
+			if (!TransmitFile(socket, region.getFile(), chunkSize, 0, nullptr, nullptr, 0))
+			{
+				int error = WSAGetLastError();
+				_log_("Nu s-a reusit trimiterea a ", chunkSize, " bytes din fisier, error = ", error);
+				return error;
+			}
+			sent += chunkSize;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveBufferToFile(const std::string& path, Buffer& buffer)
+	{
+		if (socket == INVALID_SOCKET)
+		{
+			_log_("Socket-ul nu este valid pentru primire de date.");
+			return ERROR_INVALID_HANDLE;
+		}
+
+		unsigned char header[Buffer::maxHeaderSize];
+		size_t headerSize, dataSize;
+		Buffer::BufferType type;
+		Buffer received;
+		hold();
+		ScopeGuard releaseConnection([this] { release(); });
+		if (int error = startOperation(Deadline()); error)
+			return error;
+		if (isFlowControlled())
+		{
+			// The next frame that starts is received, or reassembled from its slices, directly in the mapped file;
+			// only a frame already in an inbox, or already started, when the call is made is copied to the file
+			filePath = &path;
+			fileChannel = Protocol::channelCount;
+			ScopeGuard disarm([this] { filePath = nullptr; });
+			while (!takeReceived(received, fileChannel < Protocol::channelCount ? fileChannel : Protocol::Channel::Any))
+				if (int error = receiveNext(); error)
+					return error;
+			if (int error = frameConsumed(); error)
+				return error;
+			if (fileChannel < Protocol::channelCount)
+			{
+				buffer = std::move(received);
+				return ERROR_SUCCESS;
+			}
+			headerSize = received.getHeaderSize();
+			dataSize = received.getDataSize();
+		}
+		else if (int error = receiveHeader(header, headerSize, type, dataSize); error)
+			return error;
+
+		void* view = nullptr;
+		if (int error = mapFile(path, (unsigned long long)headerSize + dataSize, view); error)
+			return error;
+		ScopeGuard unmapView([view] { UnmapViewOfFile(view); });
+		if (isFlowControlled())
+			std::memcpy(view, received, received.getSize());
+		else if (int error = receiveInto(static_cast<char *>(view), header, headerSize, dataSize); error)
+			return frameCut(error);
+
+		unmapView.cancel();
+		buffer = Buffer(std::move(view), unmapFileView);
+		if (!isFlowControlled())		// Else recorded when it left its inbox
+			captured(TrafficCapture::Direction::Received, Protocol::Channel::Normal, buffer);
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::sendAll(const void* bytes, size_t size, Crc32c* crc)
+	{
+		const char* data = static_cast<const char *>(bytes);
+		const size_t blockSize = crc != nullptr ? crcBlockSize : maxTransferSize;
+		while (size > 0)
+		{
+			WSABUF block = { ULONG(std::min(size, blockSize)), const_cast<char *>(data) };
+			size_t sent = 0;
+			if (int error = transmit(&block, 1, sent); error)
+			{
+				if (error == WSAEWOULDBLOCK)
+				{
+					if (int error = waitFor(POLLWRNORM); error)
+						return error;
+					continue;
+				}
+				_log_("Nu s-a reusit trimiterea de ", size, " bytes, error = ", error);
+				return error;
+			}
+			if (crc != nullptr)
+				crc->update(data, sent);
+			data += sent;
+			size -= sent;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveHeader(unsigned char* header, size_t& headerSize, Buffer::BufferType& type, size_t& dataSize)
+	{
+		// The tag, then the size until its last byte
+		for (headerSize = 0; ; )
+		{
+			if (headerSize == Buffer::maxHeaderSize)
+			{
+				_log_("Header-ul bufferului primit nu este valid.");
+				return ERROR_INVALID_DATA;
+			}
+			if (int error = receiveAll(header + headerSize, 1); error)
+				return headerSize > 0 ? frameCut(error) : error;
+			headerSize++;
+			if (headerSize > 1 && Buffer::readHeader(header, headerSize, type, dataSize) == headerSize)
+				break;
+		}
+
+		// A corrupted size would be trusted for the memory of the frame and for where the next one starts
+		if (isChecked())
+		{
+			unsigned char check[4];
+			if (int error = receiveAll(check, sizeof(check)); error)
+				return frameCut(error);
+			Crc32c crc;
+			crc.update(header, headerSize);
+			if (readTrailer(check) != crc.value())
+			{
+				_log_("Header-ul bufferului primit este corupt, CRC-ul calculat este ", crc.value(), " in loc de ", readTrailer(check), ".");
+				return ERROR_CRC;
+			}
+		}
+		return checkFrameSize(headerSize, dataSize);
+	}
+
+	int ClientSocketImpl::checkFrameSize(size_t headerSize, size_t dataSize) const
+	{
+		if (headerSize > maxFrameSize || dataSize > maxFrameSize - headerSize)
+		{
+			_log_("Bufferul anuntat de ", dataSize, " bytes depaseste dimensiunea maxima de ", maxFrameSize, " bytes.");
+			return ERROR_INVALID_DATA;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::receiveAll(void* bytes, size_t size, Crc32c* crc)
+	{
+		char* data = static_cast<char *>(bytes);
+
+		const size_t cached = std::min(size, cacheEnd - cacheBegin);
+		std::memcpy(data, receiveCache + cacheBegin, cached);
+		if (crc != nullptr)
+			crc->update(data, cached);
+		cacheBegin += cached;
+		data += cached;
+		size -= cached;
+
+		while (size > 0)
+		{
+			// Large reads go directly to the destination, small ones fill the cache
+			const bool readAhead = size < receiveCacheSize;
+			char* destination = readAhead ? receiveCache : data;
+			const size_t capacity = readAhead ? receiveCacheSize : std::min(size, maxTransferSize);
+			size_t received = 0;
+			if (int error = receiveSome(destination, capacity, received); error)
+			{
+				if (error == WSAEWOULDBLOCK)
+				{
+					if (int error = waitFor(POLLRDNORM); error)
+						return error;
+					continue;
+				}
+				_log_("Apelul recv a intors eroarea ", error);
+				return error;
+			}
+			if (received == 0)
+			{
+				_log_("Conexiunea a fost inchisa inainte de primirea a ", size, " bytes.");
+				return WSAEDISCON;
+			}
+			if (readAhead)
+			{
+				const size_t used = std::min(size, received);
+				std::memcpy(data, receiveCache, used);
+				cacheBegin = used;
+				cacheEnd = received;
+				received = used;
+			}
+			if (crc != nullptr)
+				crc->update(data, received);
+			data += received;
+			size -= received;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::sendTrailer(const Crc32c& crc)
+	{
+		unsigned char trailer[4];
+		writeTrailer(crc.value(), trailer);
+		return sendAll(trailer, sizeof(trailer));
+	}
+
+	int ClientSocketImpl::checkTrailer(const Crc32c& crc)
+	{
+		unsigned char trailer[4];
+		if (int error = receiveAll(trailer, sizeof(trailer)); error)
+			return error;
+
+		const uint32_t expected = readTrailer(trailer);
+		if (expected != crc.value())
+		{
+			_log_("Frame-ul primit este corupt, CRC-ul calculat este ", crc.value(), " in loc de ", expected, ".");
+			return ERROR_CRC;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int ClientSocketImpl::checksumFileRegion(const FileRegion& region, Crc32c& crc)
+	{
+		std::unique_ptr<char[]> block(new char[crcBlockSize]);
+		for (unsigned long long done = 0; done < region.getLength(); )
+		{
+			const unsigned long long offset = region.getOffset() + done;
+			OVERLAPPED position = {};
+			position.Offset = DWORD(offset & 0xFFFFFFFF);
+			position.OffsetHigh = DWORD(offset >> 32);
+			const DWORD blockSize = DWORD(std::min<unsigned long long>(region.getLength() - done, crcBlockSize));
+			DWORD read = 0;
+			if (!ReadFile(region.getFile(), block.get(), blockSize, &read, &position) || read == 0)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut citi fisierul la ", offset, " pentru CRC, error = ", error);
+				return error != ERROR_SUCCESS ? error : ERROR_HANDLE_EOF;
+			}
+			crc.update(block.get(), read);
+			done += read;
+		}
 		return ERROR_SUCCESS;
 	}
 }
@@ -2,6 +2,16 @@
 
 #include "Socket.hpp"
 #include "ClientSocket.hpp"
+#include "Protocol.hpp"
+#include "Crc32c.hpp"
+#include "MpscQueue.hpp"
+#include "TrafficCapture.hpp"
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 namespace Communication
 {
@@ -9,17 +19,242 @@ namespace Communication
 		: public Socket
 		, public ClientSocket
 	{
+	protected:
 		SOCKET socket = INVALID_SOCKET;
+		Deadline deadline;						// Of the current operation
+		std::atomic<bool> cancelled{ false };
+		SOCKET wakeSocket = INVALID_SOCKET;		// Wakes the waits, see cancel
+
+	private:
 		addrinfo hints, *result = nullptr;
+		unsigned char requestedFeatures = Protocol::Feature::None;
+		unsigned char features = Protocol::Feature::None;		// Negotiated by handshake
+		int failure = ERROR_SUCCESS;			// WSAETIMEDOUT once a frame was cut by a timeout
+
+		/** Bytes received ahead of the current read, so small reads (e.g. headers) do not need a recv each. */
+		static constexpr size_t receiveCacheSize = 16 * 1024;
+		char receiveCache[receiveCacheSize];
+		size_t cacheBegin = 0, cacheEnd = 0;
+
+		/** A frame of a send queue, sent whole or, with channels, in slices. */
+		struct OutgoingFrame
+		{
+			Buffer buffer;
+			size_t sliced = 0;			// Bytes of the buffer already given to transmissions
+		};
+
+		/** What is on the wire: a whole frame, a slice or a control frame, sent as far as the socket takes it. */
+		struct Transmission
+		{
+			unsigned char prefix[Buffer::maxHeaderSize + 4 + 1];	// Header, its CRC and the channel of a slice
+			size_t prefixSize = 0;
+			const char* body = nullptr;
+			size_t bodySize = 0;
+			unsigned char trailer[4];
+			size_t trailerSize = 0;
+			size_t sent = 0;
+			std::deque<OutgoingFrame>* queue = nullptr;		// Where the frame comes from
+			bool last = false;								// The frame leaves its queue when this is sent
+
+			size_t getSize() const { return prefixSize + bodySize + trailerSize; }
+		};
+
+		/** A frame given to sendBuffer by a concurrent sender, see enableConcurrentSends. */
+		struct PendingFrame
+		{
+			Buffer buffer;
+			unsigned char channel = Protocol::Channel::Normal;
+		};
+
+		/** A frame of a channel of which only the first slices arrived. */
+		struct Reassembly
+		{
+			Buffer frame;
+			char* bytes = nullptr;
+			size_t size = 0;
+			size_t received = 0;		// 0 if no frame is in progress
+			bool inFile = false;		// Reassembled in the mapped file of receiveBufferToFile
+		};
+
+		// Flow control and channels, see Protocol::Feature
+		size_t receiveWindow = Protocol::defaultReceiveWindow;
+		size_t sendQueueLimit = Protocol::defaultSendQueueLimit;
+		size_t sliceSize = Protocol::defaultSliceSize;
+		size_t maxFrameSize = Protocol::defaultMaxFrameSize;
+		size_t sendCredits = 0;					// Frames the peer has room for
+		size_t consumedFrames = 0;				// Given to the application since the last credits were granted
+		std::deque<OutgoingFrame> sendQueues[Protocol::channelCount];
+		std::deque<OutgoingFrame> controlQueue;	// Sent between transmissions, without credits
+		/** Transmissions written together by one WSASend, a ring in the order of their bytes on the wire. */
+		static constexpr size_t maxBatchSize = 16;
+		Transmission batch[maxBatchSize];
+		size_t batchBegin = 0, batchSize = 0;
+		std::atomic<size_t> queuedBytes{ 0 };		// Pending frames included
+		std::deque<Buffer> inboxes[Protocol::channelCount];		// Frames not yet taken by the application
+		size_t inboxFrames = 0;					// At most receiveWindow
+		Reassembly reassemblies[Protocol::channelCount];
+		Buffer recycled;						// Memory given back by the application, for the next frame
+		Buffer controlFrame;
+		const std::string* filePath = nullptr;	// While receiveBufferToFile waits, the next frame that starts is received in this file
+		unsigned char fileChannel = Protocol::channelCount;		// The channel of that frame, once it started
+
+		// Concurrent sends: the thread that holds the connection moves the pending frames to the send queues
+		bool concurrentSends = false;
+		std::atomic<bool> holding{ false };
+		MpscQueue<PendingFrame> pendingFrames;
+		std::atomic<size_t> pendingCount{ 0 };
+		std::mutex holdMutex;
+		std::condition_variable holdChanged;	// The connection was let go, the send queue went under its mark or it was cancelled
+
+		std::unique_ptr<TrafficCapture> capture;		// See enableCapture
 
 	public:
 		ClientSocketImpl();
 		ClientSocketImpl(SOCKET socket);
 		~ClientSocketImpl();
 
-		virtual int connect(const std::string& hostname, int port) override;
+		virtual int connect(const std::string& hostname, int port, const Deadline& deadline = Deadline()) override;
 		virtual int close() override;
-		virtual int sendBuffer(const Buffer& buffer) override;
-		virtual int receiveBuffer(Buffer& buffer) override;
+		virtual void cancel() override;
+		virtual int sendBuffer(const Buffer& buffer, unsigned char channel = Protocol::Channel::Normal, const Deadline& deadline = Deadline()) override;
+		virtual int sendBuffer(Buffer&& buffer, unsigned char channel = Protocol::Channel::Normal, const Deadline& deadline = Deadline()) override;
+		virtual int trySendBuffer(const Buffer& buffer, unsigned char channel = Protocol::Channel::Normal) override;
+		virtual int pump() override;
+		virtual int receiveBuffer(Buffer& buffer, unsigned char channel = Protocol::Channel::Any, const Deadline& deadline = Deadline()) override;
+		virtual int tryReceiveBuffer(Buffer& buffer, unsigned char channel = Protocol::Channel::Any) override;
+		virtual size_t getQueuedBytes() const override { return queuedBytes; }
+		virtual std::string getPeerAddress() const override;
+
+		virtual int sendFileRegion(const FileRegion& region) override;
+		virtual int receiveBufferToFile(const std::string& path, Buffer& buffer) override;
+
+		virtual void enableIntegrityCheck() override;
+		virtual void enableFlowControl(size_t receiveWindow, size_t sendQueueLimit) override;
+		virtual void enableChannels(size_t sliceSize) override;
+		virtual void enableConcurrentSends() override;
+		virtual void setMaxFrameSize(size_t maxFrameSize) override;
+		virtual int enableCapture(const std::string& path) override;
+
+		/** Exchanges the Hello messages, must precede any other transfer on the connection. */
+		int handshake(const Deadline& deadline = Deadline());
+		/** See WaitForInput: the connections are of the same kind, all made by the library and none with concurrent sends. */
+		static int waitForInput(ClientSocket* const* sockets, size_t count, int timeout);
+		unsigned char getFeatures() const { return features; }
+
+	protected:
+		// The system calls of the transfers, replaced by RioClientSocketImpl
+		/** Sends what the socket takes now of the buffers, WSAEWOULDBLOCK if nothing. */
+		virtual int transmit(WSABUF* buffers, DWORD bufferCount, size_t& sent);
+		/** Receives at most capacity bytes already arrived, WSAEWOULDBLOCK if none; received is 0 once the peer closed. */
+		virtual int receiveSome(char* bytes, size_t capacity, size_t& received);
+		/** True if bytes arrived that receiveSome did not take yet. */
+		virtual bool isReadable();
+		/** Waits until the socket is ready for events, or the wake socket, until the deadline. ready is 0 if the wake socket alone ended the wait. */
+		virtual int poll(short events, short& ready);
+		/** Waits until one of the connections, this one first among them, can be read or written, at most timeout milliseconds. */
+		virtual int pollAny(const std::vector<ClientSocketImpl *>& connections, int timeout);
+		/** The connections one pollAny waits for share it: nullptr for sockets WSAPoll serves. */
+		virtual const void* getPollGroup() const { return nullptr; }
+		/** Sends the bytes of the region from skipped on, after the header already sent. */
+		virtual int transmitFile(const FileRegion& region, unsigned long long skipped);
+		/** Before the socket is closed: waits until the bytes taken by transmit left. */
+		virtual void awaitTransmitted(const Deadline& deadline) {}
+		/** After the socket is closed, which ended the requests on it: releases what they used. */
+		virtual void closed() {}
+
+		/** Sends all the bytes, send may send only a part of them. The optional crc is updated with the bytes sent. */
+		int sendAll(const void* bytes, size_t size, Crc32c* crc = nullptr);
+		void collectPending();
+
+	private:
+		/** Fails if the connection was cancelled or cut by a timeout, else the deadline applies to the waits that follow. */
+		int startOperation(const Deadline& deadline);
+		/** A timeout in the middle of a frame leaves the stream out of sync, so the connection cannot be used anymore. */
+		int frameCut(int error);
+
+		/** With concurrent sends only one thread at a time uses the connection, the others queue their frames. */
+		void hold();
+		bool tryHold();
+		/** Lets the connection go, writing first the frames queued meanwhile if no other thread takes it. */
+		void release();
+		/** Wakes the threads waiting for holdChanged; the mutex keeps the change from falling between their check and their wait. */
+		void signalHoldChanged();
+		/** Blocks the sender over the high-water mark until holdChanged or the deadline. */
+		void awaitHoldChanged(const Deadline& deadline);
+		int sendConcurrently(Buffer&& buffer, unsigned char channel, const Deadline& deadline, bool wait);
+		/** Records a frame of the application, if the connection is captured. */
+		void captured(TrafficCapture::Direction direction, unsigned char channel, const Buffer& frame)
+		{
+			if (capture)
+				capture->record(direction, channel, frame);
+		}
+
+		bool isFlowControlled() const { return (features & Protocol::Feature::FlowControl) != 0; }
+		bool isChecked() const { return (features & Protocol::Feature::Crc32c) != 0; }
+		/** Without channels every frame goes through the queue and the inbox of the Normal channel. */
+		size_t channelIndex(unsigned char channel) const
+		{
+			return (features & Protocol::Feature::Channels) != 0 ? channel : Protocol::Channel::Normal;
+		}
+
+		/** Sends a whole frame and its trailer, blocking. */
+		int sendFrame(const Buffer& buffer);
+		/** Receives a whole frame, checking its trailer. */
+		int receiveFrame(Buffer& buffer);
+		/** Receives the rest of a frame whose header was already received. */
+		int receivePayload(const unsigned char* header, size_t headerSize, size_t dataSize, Buffer& buffer);
+		/** Writes the header to bytes, which hold the whole frame, and receives the payload after it, checking its trailer. */
+		int receiveInto(char* bytes, const unsigned char* header, size_t headerSize, size_t dataSize);
+		/** Receives an unsliced frame, whose header was already received, in the file receiveBufferToFile waits for. */
+		int receiveFileFrame(const unsigned char* header, size_t headerSize, size_t dataSize);
+		/** receiveBuffer with flow control. */
+		int receiveQueued(Buffer& buffer, unsigned char channel);
+
+		/** pump, for the operations that already started. */
+		int pumpQueues();
+		/** Waits, if wait is set, until the send queue is under its high-water mark. */
+		int waitForQueueSpace(bool wait);
+		int enqueue(Buffer&& buffer, unsigned char channel);
+		void enqueueControl(Protocol::Control kind, uint64_t value);
+		/** Sends queued frames until the socket would block or the peer has no more credits. */
+		int flushQueues();
+		/** Prepares the next transmission: a control frame, else a slice of the highest priority channel that can send. */
+		bool startTransmission(Transmission& transmission);
+		/** The first frame of the queue that is not entirely in the batch, nullptr if none. */
+		OutgoingFrame* nextFrame(std::deque<OutgoingFrame>& queue);
+		bool canSend();
+		bool hasQueued() const;
+
+		/** Blocks until the socket can be read or written, then receives one frame or flushes the queues. */
+		int progress();
+		/** Receives one frame: control frames are applied, slices are reassembled, whole frames go to an inbox. */
+		int receiveNext();
+		int receiveSlice(const unsigned char* header, size_t headerSize, size_t dataSize);
+		int deliver(size_t channel, Buffer&& frame);
+		/** Moves the first frame of the channel's inbox (any channel, by priority, for Channel::Any) to buffer. */
+		bool takeReceived(Buffer& buffer, unsigned char channel);
+		int applyControl(const Buffer& frame);
+		/** Grants the peer the credits of the frames given to the application, half a window at a time. */
+		int frameConsumed();
+
+		/** True if a frame can be read: bytes are cached or waiting in the socket. */
+		bool hasInput();
+
+		/** The socket is non-blocking, except around TransmitFile. */
+		int setBlocking(bool blocking);
+		/** Waits until the socket is ready for events; waiting to read also sends queued frames. */
+		int waitFor(short events);
+		/** Receives the variable-length header of the next buffer, and its CRC, checked before the size is trusted. */
+		int receiveHeader(unsigned char* header, size_t& headerSize, Buffer::BufferType& type, size_t& dataSize);
+		/** ERROR_INVALID_DATA if the frame is larger than maxFrameSize. */
+		int checkFrameSize(size_t headerSize, size_t dataSize) const;
+		/** Receives exactly size bytes, reading ahead into the receive cache when size is small. */
+		int receiveAll(void* bytes, size_t size, Crc32c* crc = nullptr);
+
+		/** The CRC32C trailer of a frame, little-endian; a header is followed by its CRC in the same form. */
+		int sendTrailer(const Crc32c& crc);
+		int checkTrailer(const Crc32c& crc);
+		/** TransmitFile does not expose the bytes it sends, so the region is read for its CRC. */
+		int checksumFileRegion(const FileRegion& region, Crc32c& crc);
 	};
 }
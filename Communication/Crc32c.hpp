@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define COMMUNICATION_CRC32C_X86
+#define COMMUNICATION_CRC32C_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define COMMUNICATION_CRC32C_X86
+#define COMMUNICATION_CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(__ARM_FEATURE_CRC32) || defined(_M_ARM64)
+#include <arm_acle.h>
+#define COMMUNICATION_CRC32C_ARM
+#endif
+
+namespace Communication
+{
+	/**
+	 * Incremental CRC32C (Castagnoli polynomial), used to check the integrity of frames.
+	 * Uses the SSE4.2 (detected at run time) or ARMv8 crc32 instructions, otherwise a slicing-by-8 table.
+	 */
+	class Crc32c
+	{
+		uint32_t state = 0xFFFFFFFF;
+
+		struct Tables
+		{
+			uint32_t values[8][256];
+
+			Tables()
+			{
+				constexpr uint32_t polynomial = 0x82F63B78;		// Reflected 0x1EDC6F41
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					uint32_t crc = i;
+					for (int bit = 0; bit < 8; bit++)
+						crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+					values[0][i] = crc;
+				}
+				for (int k = 1; k < 8; k++)
+					for (int i = 0; i < 256; i++)
+						values[k][i] = (values[k - 1][i] >> 8) ^ values[0][values[k - 1][i] & 0xFF];
+			}
+		};
+
+		static uint32_t read32(const unsigned char* bytes)
+		{
+			return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+		}
+
+		static uint32_t updateTable(uint32_t crc, const unsigned char* bytes, size_t size)
+		{
+			static const Tables tables;
+			const auto& t = tables.values;
+			for (; size >= 8; size -= 8, bytes += 8)
+			{
+				const uint32_t low = crc ^ read32(bytes);
+				const uint32_t high = read32(bytes + 4);
+				crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+					^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+			}
+			for (; size > 0; size--, bytes++)
+				crc = t[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+			return crc;
+		}
+
+#if defined(COMMUNICATION_CRC32C_X86)
+		static bool hasSse42()
+		{
+			static const bool supported = []
+			{
+#if defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 1);
+				return (info[2] & (1 << 20)) != 0;
+#else
+				unsigned int eax, ebx, ecx, edx;
+				return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+			}();
+			return supported;
+		}
+
+		COMMUNICATION_CRC32C_TARGET static uint32_t updateHardware(uint32_t crc, const unsigned char* bytes, size_t size)
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			uint64_t crc64 = crc;
+			for (; size >= 8; size -= 8, bytes += 8)
+			{
+				uint64_t value;
+				std::memcpy(&value, bytes, sizeof(value));
+				crc64 = _mm_crc32_u64(crc64, value);
+			}
+			crc = uint32_t(crc64);
+#else
+			for (; size >= 4; size -= 4, bytes += 4)
+			{
+				uint32_t value;
+				std::memcpy(&value, bytes, sizeof(value));
+				crc = _mm_crc32_u32(crc, value);
+			}
+#endif
+			for (; size > 0; size--, bytes++)
+				crc = _mm_crc32_u8(crc, *bytes);
+			return crc;
+		}
+#elif defined(COMMUNICATION_CRC32C_ARM)
+		static uint32_t updateHardware(uint32_t crc, const unsigned char* bytes, size_t size)
+		{
+			for (; size >= 8; size -= 8, bytes += 8)
+			{
+				uint64_t value;
+				std::memcpy(&value, bytes, sizeof(value));
+				crc = __crc32cd(crc, value);
+			}
+			for (; size > 0; size--, bytes++)
+				crc = __crc32cb(crc, *bytes);
+			return crc;
+		}
+#endif
+
+	public:
+		void update(const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char *>(data);
+#if defined(COMMUNICATION_CRC32C_X86)
+			if (hasSse42())
+			{
+				state = updateHardware(state, bytes, size);
+				return;
+			}
+#elif defined(COMMUNICATION_CRC32C_ARM)
+			state = updateHardware(state, bytes, size);
+			return;
+#endif
+			state = updateTable(state, bytes, size);
+		}
+
+		uint32_t value() const
+		{
+			return ~state;
+		}
+	};
+
+	inline uint32_t crc32c(const void* data, size_t size)
+	{
+		Crc32c crc;
+		crc.update(data, size);
+		return crc.value();
+	}
+}
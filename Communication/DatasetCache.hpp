@@ -0,0 +1,96 @@
+#pragma once
+
+#include <list>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "Buffer.hpp"
+#include "Hash.hpp"
+
+namespace Communication
+{
+	/** Identifies a dataset partition by the hash of its serialized bytes, all 64 bits of it on 32-bit targets too. */
+	using DatasetId = uint64_t;
+
+	/** Same value as the hash computed by packBuffers while the buffer is built. */
+	inline DatasetId getDatasetId(const Buffer& buffer)
+	{
+		return DatasetId(hashBytes(buffer, buffer.getSize()));
+	}
+
+	/** Memory a Slave may use for resident datasets, when not given on the command line. */
+	constexpr size_t defaultDatasetCacheCapacity = size_t(512) << 20;
+
+	/**
+	 * Datasets kept on a Slave between tasks, so the Master can send only their id.
+	 * When the total size exceeds the capacity the least recently used datasets are evicted.
+	 */
+	class DatasetCache
+	{
+		struct Entry
+		{
+			DatasetId id;
+			Buffer buffer;
+		};
+
+		std::list<Entry> entries;		// Most recently used first
+		std::unordered_map<DatasetId, std::list<Entry>::iterator> index;
+		size_t capacity;
+		size_t usedSize = 0;
+		std::function<void(DatasetId, Buffer&&)> evictionHandler;
+
+	public:
+		explicit DatasetCache(size_t capacity = defaultDatasetCacheCapacity)
+			: capacity(capacity) {}
+		DatasetCache(const DatasetCache&) = delete;
+		void operator =(const DatasetCache&) = delete;
+
+		/** Returns the dataset and marks it as most recently used, nullptr if not resident. */
+		const Buffer* find(DatasetId id)
+		{
+			auto it = index.find(id);
+			if (it == index.end())
+				return nullptr;
+			entries.splice(entries.begin(), entries, it->second);
+			return &it->second->buffer;
+		}
+
+		/**
+		 * Takes the dataset, evicting older ones if needed; their ids are appended to evicted.
+		 * Datasets larger than the capacity are not taken, in which case nullptr is returned.
+		 */
+		const Buffer* insert(DatasetId id, Buffer&& buffer, std::vector<DatasetId>& evicted)
+		{
+			if (const Buffer* resident = find(id))
+				return resident;
+			if (buffer.getSize() > capacity)
+				return nullptr;
+
+			while (usedSize + buffer.getSize() > capacity)
+			{
+				Entry& oldest = entries.back();
+				evicted.push_back(oldest.id);
+				usedSize -= oldest.buffer.getSize();
+				if (evictionHandler)
+					evictionHandler(oldest.id, std::move(oldest.buffer));
+				index.erase(oldest.id);
+				entries.pop_back();
+			}
+
+			usedSize += buffer.getSize();
+			entries.push_front(Entry{ id, std::move(buffer) });
+			index[id] = entries.begin();
+			return &entries.front().buffer;
+		}
+
+		/** Called with every evicted buffer, before it is destroyed. */
+		void setEvictionHandler(std::function<void(DatasetId, Buffer&&)> handler)
+		{
+			evictionHandler = std::move(handler);
+		}
+
+		bool contains(DatasetId id) const { return index.count(id) != 0; }
+		size_t getUsedSize() const { return usedSize; }
+		size_t getCapacity() const { return capacity; }
+	};
+}
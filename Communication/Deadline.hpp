@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <climits>
+
+namespace Communication
+{
+	/** Point in time by which a blocking operation has to end, operations given none wait indefinitely. */
+	class Deadline
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point time;
+		bool infinite = true;
+
+	public:
+		Deadline() = default;
+
+		static Deadline after(std::chrono::milliseconds timeout)
+		{
+			Deadline deadline;
+			deadline.time = Clock::now() + timeout;
+			deadline.infinite = false;
+			return deadline;
+		}
+
+		bool isInfinite() const
+		{
+			return infinite;
+		}
+		bool hasExpired() const
+		{
+			return !infinite && Clock::now() >= time;
+		}
+
+		/** Milliseconds left, rounded up, as WSAPoll expects them: -1 if infinite, 0 if expired. */
+		int getRemainingMilliseconds() const
+		{
+			if (infinite)
+				return -1;
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(time - Clock::now()).count();
+			return remaining <= 0 ? 0 : remaining >= INT_MAX ? INT_MAX : int(remaining);
+		}
+	};
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+namespace Communication
+{
+	/**
+	 * The wire format is little-endian with fixed widths, so hosts with a different byte order or
+	 * different sizes of size_t and wchar_t read the same bytes. Conversions are free on little-endian
+	 * hosts whose widths match the wire ones (e.g. x64 Windows and Linux, except for wchar_t on Linux).
+	 */
+	namespace Endian
+	{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		constexpr bool hostIsLittleEndian = false;
+#else
+		constexpr bool hostIsLittleEndian = true;		// Every Windows target
+#endif
+
+		/** Type of the values on the wire, unsigned integers (size_t, uint64_t) are 64-bit. */
+		template<typename T> struct WireType
+		{
+			static_assert(std::is_unsigned<T>::value && sizeof(T) <= 8, "Type without a wire format.");
+			using type = uint64_t;
+		};
+		template<> struct WireType<bool> { using type = uint8_t; };
+		template<> struct WireType<char> { using type = char; };
+		template<> struct WireType<wchar_t> { using type = uint32_t; };		// 2 bytes on Windows, 4 on Linux
+		template<> struct WireType<int> { using type = int32_t; };
+		template<> struct WireType<float> { using type = float; };
+		template<> struct WireType<double> { using type = double; };
+
+		static_assert(sizeof(float) == 4 && sizeof(double) == 8, "The wire format requires IEEE 754 float and double.");
+
+		template<typename T> constexpr size_t wireSize()
+		{
+			return sizeof(typename WireType<T>::type);
+		}
+
+		namespace Detail
+		{
+			inline uint16_t swap16(uint16_t value)
+			{
+				return uint16_t((value << 8) | (value >> 8));
+			}
+			inline uint32_t swap32(uint32_t value)
+			{
+				return (value << 24) | ((value << 8) & 0x00FF0000) | ((value >> 8) & 0x0000FF00) | (value >> 24);
+			}
+			inline uint64_t swap64(uint64_t value)
+			{
+				return (uint64_t(swap32(uint32_t(value))) << 32) | swap32(uint32_t(value >> 32));
+			}
+
+			template<typename Word, Word(*swap)(Word)> void swapScalar(unsigned char* bytes, size_t count)
+			{
+				for (size_t i = 0; i < count; i++, bytes += sizeof(Word))
+				{
+					Word value;
+					std::memcpy(&value, bytes, sizeof(Word));
+					value = swap(value);
+					std::memcpy(bytes, &value, sizeof(Word));
+				}
+			}
+
+			/** Swaps as many whole 16 or 32 byte blocks as possible, returns the number of values swapped. */
+			inline size_t swapVector(unsigned char* bytes, size_t count, size_t width)
+			{
+				size_t done = 0;
+#if defined(__AVX2__)
+				const __m256i masks[] = {
+					_mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14),
+					_mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12),
+					_mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8) };
+				const __m256i mask = masks[width == 2 ? 0 : width == 4 ? 1 : 2];
+				const size_t perBlock = sizeof(__m256i) / width;
+				for (; count - done >= perBlock; done += perBlock, bytes += sizeof(__m256i))
+				{
+					__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(bytes), _mm256_shuffle_epi8(block, mask));
+				}
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+				// SSE2 has no byte shuffle: swap the bytes of the 16-bit words, then the words themselves
+				const size_t perBlock = sizeof(__m128i) / width;
+				for (; count - done >= perBlock; done += perBlock, bytes += sizeof(__m128i))
+				{
+					__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+					block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+					if (width >= 4)
+					{
+						block = _mm_shufflelo_epi16(block, _MM_SHUFFLE(2, 3, 0, 1));
+						block = _mm_shufflehi_epi16(block, _MM_SHUFFLE(2, 3, 0, 1));
+					}
+					if (width == 8)
+						block = _mm_shuffle_epi32(block, _MM_SHUFFLE(2, 3, 0, 1));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(bytes), block);
+				}
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+				const size_t perBlock = 16 / width;
+				for (; count - done >= perBlock; done += perBlock, bytes += 16)
+				{
+					uint8x16_t block = vld1q_u8(bytes);
+					block = width == 2 ? vrev16q_u8(block) : width == 4 ? vrev32q_u8(block) : vrev64q_u8(block);
+					vst1q_u8(bytes, block);
+				}
+#endif
+				return done;
+			}
+		}
+
+		/** Reverses the bytes of count consecutive values of width bytes (1, 2, 4 or 8). */
+		inline void swapBytes(void* data, size_t count, size_t width)
+		{
+			if (width == 1)
+				return;
+			unsigned char* bytes = static_cast<unsigned char *>(data);
+			const size_t done = Detail::swapVector(bytes, count, width);
+			bytes += done * width;
+			count -= done;
+			switch (width)
+			{
+			case 2: Detail::swapScalar<uint16_t, Detail::swap16>(bytes, count); break;
+			case 4: Detail::swapScalar<uint32_t, Detail::swap32>(bytes, count); break;
+			case 8: Detail::swapScalar<uint64_t, Detail::swap64>(bytes, count); break;
+			}
+		}
+
+		/** Writes count values in the wire format, destination must have count * wireSize<T>() bytes. */
+		template<typename T> void toWire(const T* values, size_t count, void* destination)
+		{
+			using Wire = typename WireType<T>::type;
+			if constexpr (sizeof(Wire) == sizeof(T))
+				std::memcpy(destination, values, count * sizeof(T));
+			else
+				for (size_t i = 0; i < count; i++)
+				{
+					const Wire value = Wire(values[i]);
+					std::memcpy(static_cast<char *>(destination) + i * sizeof(Wire), &value, sizeof(Wire));
+				}
+			if constexpr (!hostIsLittleEndian)
+				swapBytes(destination, count, sizeof(Wire));
+		}
+
+		/** Reads count values written by toWire. */
+		template<typename T> void fromWire(const void* source, size_t count, T* values)
+		{
+			using Wire = typename WireType<T>::type;
+			if constexpr (sizeof(Wire) == sizeof(T))
+			{
+				std::memcpy(values, source, count * sizeof(T));
+				if constexpr (!hostIsLittleEndian)
+					swapBytes(values, count, sizeof(T));
+			}
+			else
+				for (size_t i = 0; i < count; i++)
+				{
+					Wire value;
+					std::memcpy(&value, static_cast<const char *>(source) + i * sizeof(Wire), sizeof(Wire));
+					if constexpr (!hostIsLittleEndian)
+						swapBytes(&value, 1, sizeof(Wire));
+					values[i] = T(value);
+				}
+		}
+	}
+}
@@ -13,6 +13,13 @@ namespace Communication
 {
 	COMMUNICATION_TAG	ClientSocket*	CreateClientSocket();
 	COMMUNICATION_TAG	void			DeleteClientSocket(ClientSocket *);
+	/**
+	 * Blocks until one of the connections received a frame, or can send its queued frames, at most timeout
+	 * milliseconds (-1 is infinite). Returns WSAETIMEDOUT if none did; the frames are then taken by tryReceiveBuffer.
+	 * Connections served by Registered I/O are waited for only together with those accepted by the same server,
+	 * else ERROR_INVALID_PARAMETER is returned.
+	 */
+	COMMUNICATION_TAG	int				WaitForInput(ClientSocket* const* sockets, size_t count, int timeout);
 
 	COMMUNICATION_TAG	ServerSocket*	CreateServerSocket();
 	COMMUNICATION_TAG	void			DeleteServerSocket(ServerSocket *);
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+#include "Buffer.hpp"
+
+namespace Communication
+{
+	/**
+	 * Part of a file, sent by ClientSocket::sendFileRegion directly from the file cache to the socket.
+	 * The region holds either raw fundamental values, sent as an Array buffer, or a whole buffer
+	 * (header included) previously written by ClientSocket::receiveBufferToFile.
+	 */
+	class FileRegion
+	{
+		HANDLE file = INVALID_HANDLE_VALUE;
+		unsigned long long offset = 0;
+		unsigned long long length = 0;
+		Buffer::BufferType elementType = Buffer::BufferType::Custom;
+		bool containsHeader = false;
+
+	public:
+		FileRegion() = default;
+		FileRegion(const FileRegion&) = delete;
+		void operator =(const FileRegion&) = delete;
+		~FileRegion()
+		{
+			close();
+		}
+
+		/**
+		 * Raw values of elementType, from offset to offset + length (to the end of the file if length is 0).
+		 * The values are sent as they are, so they must be in the wire format (little-endian, see Endian.hpp).
+		 */
+		int openArray(const std::string& path, Buffer::BufferType elementType, unsigned long long offset = 0, unsigned long long length = 0)
+		{
+			if (int error = open(path); error)
+				return error;
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize))
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut afla dimensiunea fisierului \"", path, "\", error = ", error);
+				close();
+				return error;
+			}
+			const unsigned long long size = static_cast<unsigned long long>(fileSize.QuadPart);
+			if (offset > size || (length != 0 && offset + length > size))
+			{
+				_log_("Regiunea [", offset, ", ", offset + length, ") depaseste fisierul \"", path, "\" de ", fileSize.QuadPart, " bytes.");
+				close();
+				return ERROR_INVALID_PARAMETER;
+			}
+
+			this->offset = offset;
+			this->length = length != 0 ? length : size - offset;
+			this->elementType = elementType;
+			containsHeader = false;
+			return ERROR_SUCCESS;
+		}
+
+		/** A whole buffer written by ClientSocket::receiveBufferToFile. */
+		int openBuffer(const std::string& path)
+		{
+			if (int error = openArray(path, Buffer::BufferType::Custom); error)
+				return error;
+			containsHeader = true;
+			return ERROR_SUCCESS;
+		}
+
+		/** Maps a file opened with openBuffer in memory; the pages are read on demand, nothing is copied. */
+		int map(Buffer& buffer) const
+		{
+			assert(containsHeader, "Doar fisierele care contin un buffer intreg pot fi mapate.");
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut mapa fisierul, error = ", error);
+				return error;
+			}
+			void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);		// The view keeps the mapping alive
+			if (view == nullptr)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut mapa in memorie fisierul, error = ", error);
+				return error;
+			}
+
+			buffer = Buffer(std::move(view), [](void *view) { UnmapViewOfFile(view); });
+			return ERROR_SUCCESS;
+		}
+
+		void close()
+		{
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+
+		HANDLE getFile() const { return file; }
+		unsigned long long getOffset() const { return offset; }
+		unsigned long long getLength() const { return length; }
+		Buffer::BufferType getElementType() const { return elementType; }
+		bool hasHeader() const { return containsHeader; }
+
+	private:
+		int open(const std::string& path)
+		{
+			close();
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut deschide fisierul \"", path, "\", error = ", error);
+				return error;
+			}
+			return ERROR_SUCCESS;
+		}
+	};
+}
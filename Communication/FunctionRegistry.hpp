@@ -0,0 +1,109 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <map>
+#include <algorithm>
+#include "Serializers.hpp"
+
+namespace Communication
+{
+	/**
+	 * Functions that can be executed remotely, identified by name.
+	 * The Master and the Slaves must register the same functions under the same names.
+	 */
+	class FunctionRegistry
+	{
+	public:
+		/** Takes a serialized std::vector<In> and returns a serialized std::vector<Out>. */
+		using MapFunction = std::function<Buffer(const Buffer&)>;
+		/** Takes a serialized non-empty std::vector<Type> and returns a single serialized Type. */
+		using CombineFunction = std::function<Buffer(const Buffer&)>;
+		/** Called once for every index of a parallelFor range. */
+		using ForFunction = std::function<void(size_t)>;
+
+	private:
+		std::map<std::string, MapFunction> mapFunctions;
+		std::map<std::string, CombineFunction> combineFunctions;
+		std::map<std::string, ForFunction> forFunctions;
+
+		FunctionRegistry() = default;
+
+	public:
+		FunctionRegistry(const FunctionRegistry&) = delete;
+		void operator =(const FunctionRegistry&) = delete;
+
+		static FunctionRegistry& instance()
+		{
+			static FunctionRegistry registry;
+			return registry;
+		}
+
+		template<typename In, typename Out> void registerMap(const std::string& id, std::function<Out(const In&)> function)
+		{
+			assert(mapFunctions.count(id) == 0, "Exista deja o functie map cu id-ul \"", id, "\".");
+			mapFunctions.emplace(id, [function](const Buffer& input)
+			{
+				std::vector<In> values = SerializerSelector<std::vector<In>>::deserialize(input);
+				std::vector<Out> results;
+				results.reserve(values.size());
+				for (const In& value : values)
+					results.push_back(function(value));
+				return SerializerSelector<std::vector<Out>>::serialize(results);
+			});
+		}
+
+		/** The reduce function must be associative, partial results are combined on every Slave and then on the Master. */
+		template<typename Type> void registerReduce(const std::string& id, std::function<Type(const Type&, const Type&)> function)
+		{
+			assert(combineFunctions.count(id) == 0, "Exista deja o functie reduce cu id-ul \"", id, "\".");
+			combineFunctions.emplace(id, [function](const Buffer& input)
+			{
+				std::vector<Type> values = SerializerSelector<std::vector<Type>>::deserialize(input);
+				assert(!values.empty(), "Nu se poate aplica reduce pe un vector gol.");
+				Type result = values[0];
+				for (size_t i = 1; i < values.size(); i++)
+					result = function(result, values[i]);
+				return SerializerSelector<Type>::serialize(result);
+			});
+		}
+
+		void registerFor(const std::string& id, ForFunction function)
+		{
+			assert(forFunctions.count(id) == 0, "Exista deja o functie for cu id-ul \"", id, "\".");
+			forFunctions.emplace(id, std::move(function));
+		}
+
+		const MapFunction* findMap(const std::string& id) const
+		{
+			auto it = mapFunctions.find(id);
+			return it == mapFunctions.end() ? nullptr : &it->second;
+		}
+		const CombineFunction* findCombine(const std::string& id) const
+		{
+			auto it = combineFunctions.find(id);
+			return it == combineFunctions.end() ? nullptr : &it->second;
+		}
+		const ForFunction* findFor(const std::string& id) const
+		{
+			auto it = forFunctions.find(id);
+			return it == forFunctions.end() ? nullptr : &it->second;
+		}
+	};
+
+	/** Registers the functions available on every node, must be called by both the Master and the Slaves. */
+	inline void registerBuiltinFunctions()
+	{
+		FunctionRegistry& registry = FunctionRegistry::instance();
+
+		registry.registerMap<int, int>("int.square", [](const int& value) { return value * value; });
+		registry.registerMap<double, double>("double.square", [](const double& value) { return value * value; });
+
+		registry.registerReduce<int>("int.sum", [](const int& a, const int& b) { return a + b; });
+		registry.registerReduce<int>("int.min", [](const int& a, const int& b) { return std::min(a, b); });
+		registry.registerReduce<int>("int.max", [](const int& a, const int& b) { return std::max(a, b); });
+		registry.registerReduce<double>("double.sum", [](const double& a, const double& b) { return a + b; });
+		registry.registerReduce<double>("double.min", [](const double& a, const double& b) { return std::min(a, b); });
+		registry.registerReduce<double>("double.max", [](const double& a, const double& b) { return std::max(a, b); });
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Communication
+{
+	/**
+	 * Incremental 64-bit xxHash, a fast non-cryptographic hash.
+	 * Bytes can be fed in any number of update calls, the digest is the same as for a single call.
+	 */
+	class Hasher
+	{
+		static constexpr uint64_t prime1 = 11400714785074694791ULL;
+		static constexpr uint64_t prime2 = 14029467366897019727ULL;
+		static constexpr uint64_t prime3 = 1609587929392839161ULL;
+		static constexpr uint64_t prime4 = 9650029242287828579ULL;
+		static constexpr uint64_t prime5 = 2870177450012600261ULL;
+
+		uint64_t accumulators[4];
+		uint64_t totalLength = 0;
+		unsigned char pending[32];
+		size_t pendingSize = 0;
+		uint64_t seed;
+
+		static uint64_t rotateLeft(uint64_t value, int bits)
+		{
+			return (value << bits) | (value >> (64 - bits));
+		}
+		static uint64_t read64(const unsigned char* bytes)
+		{
+			uint64_t value;
+			std::memcpy(&value, bytes, sizeof(value));
+			return value;
+		}
+		static uint32_t read32(const unsigned char* bytes)
+		{
+			uint32_t value;
+			std::memcpy(&value, bytes, sizeof(value));
+			return value;
+		}
+		static uint64_t round(uint64_t accumulator, uint64_t input)
+		{
+			accumulator += input * prime2;
+			accumulator = rotateLeft(accumulator, 31);
+			return accumulator * prime1;
+		}
+		static uint64_t mergeRound(uint64_t hash, uint64_t accumulator)
+		{
+			hash ^= round(0, accumulator);
+			return hash * prime1 + prime4;
+		}
+		void consumeStripe(const unsigned char* stripe)
+		{
+			for (int i = 0; i < 4; i++)
+				accumulators[i] = round(accumulators[i], read64(stripe + 8 * i));
+		}
+
+	public:
+		explicit Hasher(uint64_t seed = 0)
+			: seed(seed)
+		{
+			accumulators[0] = seed + prime1 + prime2;
+			accumulators[1] = seed + prime2;
+			accumulators[2] = seed;
+			accumulators[3] = seed - prime1;
+		}
+
+		void update(const void* data, size_t length)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char *>(data);
+			totalLength += length;
+
+			if (pendingSize + length < sizeof(pending))
+			{
+				std::memcpy(pending + pendingSize, bytes, length);
+				pendingSize += length;
+				return;
+			}
+			if (pendingSize > 0)
+			{
+				const size_t fill = sizeof(pending) - pendingSize;
+				std::memcpy(pending + pendingSize, bytes, fill);
+				consumeStripe(pending);
+				bytes += fill;
+				length -= fill;
+				pendingSize = 0;
+			}
+			for (; length >= sizeof(pending); bytes += sizeof(pending), length -= sizeof(pending))
+				consumeStripe(bytes);
+			std::memcpy(pending, bytes, length);
+			pendingSize = length;
+		}
+
+		uint64_t digest() const
+		{
+			uint64_t hash;
+			if (totalLength >= sizeof(pending))
+			{
+				hash = rotateLeft(accumulators[0], 1) + rotateLeft(accumulators[1], 7) + rotateLeft(accumulators[2], 12) + rotateLeft(accumulators[3], 18);
+				for (int i = 0; i < 4; i++)
+					hash = mergeRound(hash, accumulators[i]);
+			}
+			else
+				hash = seed + prime5;
+			hash += totalLength;
+
+			const unsigned char* bytes = pending;
+			const unsigned char* end = pending + pendingSize;
+			for (; bytes + 8 <= end; bytes += 8)
+				hash = rotateLeft(hash ^ round(0, read64(bytes)), 27) * prime1 + prime4;
+			if (bytes + 4 <= end)
+			{
+				hash = rotateLeft(hash ^ (uint64_t(read32(bytes)) * prime1), 23) * prime2 + prime3;
+				bytes += 4;
+			}
+			for (; bytes < end; bytes++)
+				hash = rotateLeft(hash ^ (*bytes * prime5), 11) * prime1;
+
+			hash ^= hash >> 33;
+			hash *= prime2;
+			hash ^= hash >> 29;
+			hash *= prime3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+	};
+
+	inline uint64_t hashBytes(const void* data, size_t length, uint64_t seed = 0)
+	{
+		Hasher hasher(seed);
+		hasher.update(data, length);
+		return hasher.digest();
+	}
+}
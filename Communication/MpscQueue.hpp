@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace Communication
+{
+	/**
+	 * Unbounded queue with many producers and one consumer (D. Vyukov's algorithm).
+	 * push is wait-free and may be called from any thread, pop only by one thread at a time.
+	 * pop may not yet see an element whose push has not returned.
+	 */
+	template<typename Type> class MpscQueue
+	{
+		struct Node
+		{
+			std::atomic<Node *> next{ nullptr };
+			Type value;
+		};
+
+		std::atomic<Node *> head;		// Last pushed
+		Node* tail;						// Last popped, or the initial node; owned by the consumer
+
+	public:
+		MpscQueue(): head(new Node()), tail(head.load())
+		{
+		}
+		~MpscQueue()
+		{
+			Type value;
+			while (pop(value))
+				;
+			delete tail;
+		}
+		MpscQueue(const MpscQueue&) = delete;
+		void operator =(const MpscQueue&) = delete;
+
+		void push(Type&& value)
+		{
+			Node* node = new Node();
+			node->value = std::move(value);
+			Node* previous = head.exchange(node, std::memory_order_acq_rel);
+			previous->next.store(node, std::memory_order_release);
+		}
+
+		bool pop(Type& value)
+		{
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return false;
+			value = std::move(next->value);
+			delete tail;
+			tail = next;
+			return true;
+		}
+	};
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstring>
+#include "Varint.hpp"
+
+namespace Communication
+{
+	/**
+	 * The Hello message exchanged by both ends right after the connection is established:
+	 * the magic bytes, the wire format version and the optional features the sender supports.
+	 */
+	namespace Protocol
+	{
+		constexpr unsigned char magic[] = { 'P', 'P', 'C', 'M' };
+
+		/**
+		 * Version 2 introduced the compact header (type tag + varint size),
+		 * version 3 the fixed-width little-endian values, version 4 the CRC32C of every header.
+		 */
+		constexpr unsigned char version = 4;
+		/** Oldest version this end can talk to. */
+		constexpr unsigned char minimumVersion = 4;
+
+		/** Optional features, used on a connection only when both ends support them. */
+		namespace Feature
+		{
+			constexpr unsigned char None = 0;
+			constexpr unsigned char Crc32c = 1 << 0;		// Every header and every frame is followed by the CRC32C of its bytes
+			constexpr unsigned char FlowControl = 1 << 1;	// A sender has only as many frames in flight as the receiver granted
+			constexpr unsigned char Channels = 1 << 2;		// Frames are sent in slices on prioritized channels, requires FlowControl
+		}
+		constexpr unsigned char supportedFeatures = Feature::Crc32c | Feature::FlowControl | Feature::Channels;
+
+		/** Largest frame a receiver accepts, a header that announces more is taken for a corrupted one. */
+		constexpr size_t defaultMaxFrameSize = size_t(1) << 30;
+
+		/** Frames a receiver accepts ahead of the application, and bytes a sender queues before producers have to wait. */
+		constexpr size_t defaultReceiveWindow = 16;
+		constexpr size_t defaultSendQueueLimit = size_t(64) << 20;
+
+		/** Logical channels of a connection, a lower number has a higher priority. */
+		namespace Channel
+		{
+			constexpr unsigned char Urgent = 0;		// Small control messages: heartbeats, cancellations, shutdown
+			constexpr unsigned char Normal = 1;		// Tasks and results
+			constexpr unsigned char Bulk = 2;		// Large transfers, e.g. datasets
+			constexpr unsigned char Any = 0xFF;		// For receiving: the next frame of the highest priority channel that has one
+		}
+		constexpr size_t channelCount = 3;
+		/** Largest slice of a frame, a frame of a higher priority channel waits at most for one slice. */
+		constexpr size_t defaultSliceSize = 16 * 1024;
+		constexpr size_t minimumSliceSize = 64;
+
+		/** Kind of a Control buffer, the first byte of its data; a varint value follows. Control buffers are not given to the application. */
+		enum class Control : unsigned char
+		{
+			Credit,		// The receiver has room for this many more frames
+		};
+		constexpr size_t maxControlSize = 1 + Varint::maxSize;
+
+		constexpr size_t helloSize = sizeof(magic) + 2;
+
+		inline void writeHello(unsigned char* hello, unsigned char features)
+		{
+			std::memcpy(hello, magic, sizeof(magic));
+			hello[sizeof(magic)] = version;
+			hello[sizeof(magic) + 1] = features;
+		}
+
+		/** Returns false if the bytes are not a Hello message. */
+		inline bool readHello(const unsigned char* hello, unsigned char& peerVersion, unsigned char& peerFeatures)
+		{
+			if (std::memcmp(hello, magic, sizeof(magic)) != 0)
+				return false;
+			peerVersion = hello[sizeof(magic)];
+			peerFeatures = hello[sizeof(magic) + 1];
+			return true;
+		}
+	}
+}
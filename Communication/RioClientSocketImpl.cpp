@@ -0,0 +1,331 @@
+#include "RioClientSocketImpl.hpp"
+#include "FileRegion.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace Communication
+{
+	/** Bytes of a file region read at once by transmitFile, a quarter of the send ring. */
+	constexpr DWORD fileBlockSize = 256 * 1024;
+
+	RioClientSocketImpl::RioClientSocketImpl(SOCKET socket, std::shared_ptr<RioCompletionQueue> completionQueue)
+		: ClientSocketImpl(socket)
+		, completionQueue(std::move(completionQueue))
+	{
+	}
+
+	RioClientSocketImpl::~RioClientSocketImpl()
+	{
+		close();
+	}
+
+	int RioClientSocketImpl::open()
+	{
+		const RIO_EXTENSION_FUNCTION_TABLE& rio = completionQueue->functions();
+
+		// Page-aligned, the registration locks it for the lifetime of the connection
+		const DWORD memorySize = receiveSlotCount * receiveSlotSize + sendRingSize;
+		memory = static_cast<char *>(VirtualAlloc(nullptr, memorySize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+		if (memory == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-au putut aloca ", memorySize, " bytes pentru Registered I/O, error = ", error);
+			return error;
+		}
+		bufferId = rio.RIORegisterBuffer(memory, memorySize);
+		if (bufferId == RIO_INVALID_BUFFERID)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut inregistra memoria conexiunii, error = ", error);
+			return error;
+		}
+
+		if (int error = completionQueue->attach(this, requestCount, id); error)
+			return error;
+		auto lock = completionQueue->lock();
+		requests = rio.RIOCreateRequestQueue(socket, receiveSlotCount, 1, maxSends, 1,
+			completionQueue->getHandle(), completionQueue->getHandle(), reinterpret_cast<void *>(id));
+		if (requests == RIO_INVALID_RQ)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut crea coada de cereri a conexiunii, error = ", error);
+			return error;
+		}
+
+		// The waits are on the completion queue, the wake socket is watched through an event
+		if (int error = createWakeSocket(wakeSocket); error)
+			return error;
+		wakeEvent = WSACreateEvent();
+		if (wakeEvent == WSA_INVALID_EVENT || WSAEventSelect(wakeSocket, wakeEvent, FD_READ) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut asocia un eveniment socketului de trezire, error = ", error);
+			return error;
+		}
+
+		// Every slot receives from the start, the last receive commits the deferred ones
+		for (ULONG slot = 0; slot < receiveSlotCount; slot++)
+			if (int error = postReceive(slot, slot + 1 < receiveSlotCount ? RIO_MSG_DEFER : 0); error)
+				return error;
+		return ERROR_SUCCESS;
+	}
+
+	void RioClientSocketImpl::closed()
+	{
+		// Closing the socket ended its requests, their memory can be released
+		unregister();
+	}
+
+	void RioClientSocketImpl::unregister()
+	{
+		if (id != 0)
+			completionQueue->detach(id, requestCount);
+		id = 0;
+		requests = RIO_INVALID_RQ;		// Closed with the socket
+		if (bufferId != RIO_INVALID_BUFFERID)
+			completionQueue->functions().RIODeregisterBuffer(bufferId);
+		bufferId = RIO_INVALID_BUFFERID;
+		if (memory != nullptr)
+			VirtualFree(memory, 0, MEM_RELEASE);
+		memory = nullptr;
+		if (wakeEvent != nullptr)
+			WSACloseEvent(wakeEvent);
+		wakeEvent = nullptr;
+
+		for (Slot& slot : slots)
+			slot = Slot();
+		nextSlot = ringBegin = ringUsed = sendsBegin = sendCount = 0;
+		ioError = ERROR_SUCCESS;
+	}
+
+	void RioClientSocketImpl::completed(ULONG_PTR request, LONG status, ULONG bytes)
+	{
+		if (status != ERROR_SUCCESS && ioError == ERROR_SUCCESS)
+			ioError = int(status);
+		if (request == sendRequest)
+		{
+			// Sends complete in the order they were posted, each frees its part of the ring
+			ringBegin = (ringBegin + sendSizes[sendsBegin]) % sendRingSize;
+			ringUsed -= sendSizes[sendsBegin];
+			sendsBegin = (sendsBegin + 1) % maxSends;
+			sendCount--;
+		}
+		else if (status == ERROR_SUCCESS)
+		{
+			Slot& slot = slots[request];
+			slot.size = bytes;
+			slot.consumed = 0;
+			slot.completed = true;
+		}
+	}
+
+	int RioClientSocketImpl::postReceive(ULONG slot, DWORD flags)
+	{
+		slots[slot] = Slot();
+		RIO_BUF buffer = { bufferId, slot * receiveSlotSize, receiveSlotSize };
+		if (!completionQueue->functions().RIOReceive(requests, &buffer, 1, flags, reinterpret_cast<void *>(ULONG_PTR(slot))))
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut posta primirea in slotul ", slot, ", error = ", error);
+			return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int RioClientSocketImpl::postSend(ULONG offset, ULONG size)
+	{
+		RIO_BUF buffer = { bufferId, receiveSlotCount * receiveSlotSize + offset, size };
+		if (!completionQueue->functions().RIOSend(requests, &buffer, 1, RIO_MSG_DEFER, reinterpret_cast<void *>(sendRequest)))
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut posta trimiterea a ", size, " bytes, error = ", error);
+			return error;
+		}
+		sendSizes[(sendsBegin + sendCount) % maxSends] = size;
+		sendCount++;
+		return ERROR_SUCCESS;
+	}
+
+	int RioClientSocketImpl::commitSends()
+	{
+		if (!completionQueue->functions().RIOSend(requests, nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr))
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-au putut porni trimiterile amanate, error = ", error);
+			return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	int RioClientSocketImpl::transmit(WSABUF* buffers, DWORD bufferCount, size_t& sent)
+	{
+		auto lock = completionQueue->lock();
+		if (requests == RIO_INVALID_RQ)
+			return WSAENOTCONN;
+		completionQueue->dequeue();
+		if (ioError != ERROR_SUCCESS)
+			return ioError;
+
+		// The buffers are copied after the bytes in flight, a send for every contiguous run of the ring
+		sent = 0;
+		ULONG end = (ringBegin + ringUsed) % sendRingSize;
+		ULONG runBegin = end, runSize = 0;
+		const ULONG postedBefore = sendCount;
+		for (DWORD i = 0; i < bufferCount && ringUsed < sendRingSize && sendCount < maxSends; i++)
+			for (ULONG copied = 0; copied < buffers[i].len && ringUsed < sendRingSize && sendCount < maxSends; )
+			{
+				const ULONG contiguous = std::min(sendRingSize - ringUsed, sendRingSize - end);
+				const ULONG size = std::min(contiguous, buffers[i].len - copied);
+				std::memcpy(memory + receiveSlotCount * receiveSlotSize + end, buffers[i].buf + copied, size);
+				copied += size;
+				sent += size;
+				ringUsed += size;
+				runSize += size;
+				end += size;
+				if (end == sendRingSize)
+				{
+					if (int error = postSend(runBegin, runSize); error)
+						return error;
+					end = runBegin = runSize = 0;
+				}
+			}
+		if (runSize > 0)
+			if (int error = postSend(runBegin, runSize); error)
+				return error;
+
+		// One commit starts all the sends of the call
+		if (sendCount > postedBefore)
+			if (int error = commitSends(); error)
+				return error;
+		return sent > 0 ? ERROR_SUCCESS : WSAEWOULDBLOCK;
+	}
+
+	int RioClientSocketImpl::receiveSome(char* bytes, size_t capacity, size_t& received)
+	{
+		auto lock = completionQueue->lock();
+		if (requests == RIO_INVALID_RQ)
+			return WSAENOTCONN;
+		completionQueue->dequeue();
+
+		Slot& slot = slots[nextSlot];
+		if (!slot.completed)
+			return ioError != ERROR_SUCCESS ? ioError : WSAEWOULDBLOCK;
+		received = std::min<size_t>(capacity, slot.size - slot.consumed);
+		std::memcpy(bytes, memory + nextSlot * receiveSlotSize + slot.consumed, received);
+		slot.consumed += ULONG(received);
+
+		// An emptied slot receives again, the slot of a closed connection stays as it is
+		if (slot.size > 0 && slot.consumed == slot.size)
+		{
+			if (int error = postReceive(nextSlot, 0); error)
+				return error;
+			nextSlot = (nextSlot + 1) % receiveSlotCount;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	bool RioClientSocketImpl::isReadable()
+	{
+		auto lock = completionQueue->lock();
+		if (requests == RIO_INVALID_RQ)
+			return false;
+		completionQueue->dequeue();
+		return slots[nextSlot].completed || ioError != ERROR_SUCCESS;
+	}
+
+	int RioClientSocketImpl::pollAny(const std::vector<ClientSocketImpl *>& connections, int timeout)
+	{
+		// waitForInput made sure the connections share the completion queue, so any of their completions ends the wait
+		bool woken = false;
+		return completionQueue->wait(nullptr, timeout, woken);
+	}
+
+	int RioClientSocketImpl::poll(short events, short& ready)
+	{
+		for (;;)
+		{
+			{
+				auto lock = completionQueue->lock();
+				if (requests == RIO_INVALID_RQ)
+					return WSAENOTCONN;
+				completionQueue->dequeue();
+				ready = 0;
+				if (slots[nextSlot].completed)
+					ready |= POLLRDNORM;
+				if (ringUsed < sendRingSize && sendCount < maxSends)
+					ready |= POLLWRNORM;
+				ready &= events;
+				if (ioError != ERROR_SUCCESS)
+					ready |= POLLERR;
+			}
+			if (cancelled)
+				return ERROR_CANCELLED;
+			if (ready != 0)
+				return ERROR_SUCCESS;
+
+			// Completions of any connection of the queue end the wait, the caller's are then in its slots
+			bool woken = false;
+			if (int error = completionQueue->wait(wakeEvent, deadline.getRemainingMilliseconds(), woken); error)
+			{
+				if (error == WSAETIMEDOUT)
+					_log_("Timpul alocat operatiei a expirat.");
+				return error;
+			}
+			if (woken)
+			{
+				// Concurrent senders queued frames or the connection was cancelled
+				WSAResetEvent(wakeEvent);
+				char drained[16];
+				while (recv(wakeSocket, drained, sizeof(drained), 0) > 0)
+					;
+				if (cancelled)
+					return ERROR_CANCELLED;
+				collectPending();
+				return ERROR_SUCCESS;
+			}
+		}
+	}
+
+	int RioClientSocketImpl::transmitFile(const FileRegion& region, unsigned long long skipped)
+	{
+		std::unique_ptr<char[]> block(new char[fileBlockSize]);
+		for (unsigned long long done = skipped; done < region.getLength(); )
+		{
+			const unsigned long long offset = region.getOffset() + done;
+			OVERLAPPED position = {};
+			position.Offset = DWORD(offset & 0xFFFFFFFF);
+			position.OffsetHigh = DWORD(offset >> 32);
+			const DWORD blockSize = DWORD(std::min<unsigned long long>(region.getLength() - done, fileBlockSize));
+			DWORD read = 0;
+			if (!ReadFile(region.getFile(), block.get(), blockSize, &read, &position) || read == 0)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut citi fisierul la ", offset, ", error = ", error);
+				return error != ERROR_SUCCESS ? error : ERROR_HANDLE_EOF;
+			}
+			if (int error = sendAll(block.get(), read); error)
+				return error;
+			done += read;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	void RioClientSocketImpl::awaitTransmitted(const Deadline& deadline)
+	{
+		for (;;)
+		{
+			{
+				auto lock = completionQueue->lock();
+				if (requests == RIO_INVALID_RQ)
+					return;
+				completionQueue->dequeue();
+				if (sendCount == 0 || ioError != ERROR_SUCCESS)
+					return;
+			}
+			bool woken = false;
+			if (completionQueue->wait(nullptr, deadline.getRemainingMilliseconds(), woken) != ERROR_SUCCESS)
+				return;
+		}
+	}
+}
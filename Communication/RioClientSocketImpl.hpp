@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ClientSocketImpl.hpp"
+#include "RioCompletionQueue.hpp"
+#include <memory>
+
+namespace Communication
+{
+	/**
+	 * An accepted connection served by Registered I/O, see ServerSocket::enableRegisteredIo. Receives are always
+	 * posted on registered slots and sends are copied to a registered ring, posted deferred and committed together,
+	 * so a transfer needs no system call of its own; the completions come through the queue of the server.
+	 */
+	class RioClientSocketImpl
+		: public ClientSocketImpl
+		, public RioCompletionQueue::Connection
+	{
+		static constexpr ULONG receiveSlotCount = 4;
+		static constexpr ULONG receiveSlotSize = 64 * 1024;
+		static constexpr ULONG sendRingSize = 1024 * 1024;
+		static constexpr ULONG maxSends = 32;			// Outstanding, a wrapped copy takes two
+		static constexpr ULONG requestCount = receiveSlotCount + maxSends;
+		static constexpr ULONG_PTR sendRequest = ~ULONG_PTR(0);		// Receives are told apart by their slot
+
+		/** A receive posted on a slot of the registered memory, read once it completed. */
+		struct Slot
+		{
+			ULONG size = 0;			// 0 once the peer closed
+			ULONG consumed = 0;
+			bool completed = false;
+		};
+
+		std::shared_ptr<RioCompletionQueue> completionQueue;
+		ULONG_PTR id = 0;
+		RIO_RQ requests = RIO_INVALID_RQ;
+		char* memory = nullptr;			// The receive slots, then the send ring
+		RIO_BUFFERID bufferId = RIO_INVALID_BUFFERID;
+		HANDLE wakeEvent = nullptr;		// Set by the wake socket
+		int ioError = ERROR_SUCCESS;	// Of a failed request
+
+		Slot slots[receiveSlotCount];
+		ULONG nextSlot = 0;				// Receives complete in the order they were posted
+		ULONG ringBegin = 0, ringUsed = 0;		// The bytes of the ring whose sends did not complete
+		ULONG sendSizes[maxSends];		// Of the outstanding sends, in the order they were posted
+		ULONG sendsBegin = 0, sendCount = 0;
+
+	public:
+		RioClientSocketImpl(SOCKET socket, std::shared_ptr<RioCompletionQueue> completionQueue);
+		~RioClientSocketImpl();
+
+		/** Registers the memory and posts the receives, before the handshake. */
+		int open();
+
+		virtual void completed(ULONG_PTR request, LONG status, ULONG bytes) override;
+
+	protected:
+		virtual int transmit(WSABUF* buffers, DWORD bufferCount, size_t& sent) override;
+		virtual int receiveSome(char* bytes, size_t capacity, size_t& received) override;
+		virtual bool isReadable() override;
+		virtual int poll(short events, short& ready) override;
+		virtual int pollAny(const std::vector<ClientSocketImpl *>& connections, int timeout) override;
+		virtual const void* getPollGroup() const override { return completionQueue.get(); }
+		/** TransmitFile would bypass the send ring, so the region is read and sent through it. */
+		virtual int transmitFile(const FileRegion& region, unsigned long long skipped) override;
+		virtual void awaitTransmitted(const Deadline& deadline) override;
+		virtual void closed() override;
+
+	private:
+		/** Posts the receive of a slot; with RIO_MSG_DEFER it starts with the next receive posted without. */
+		int postReceive(ULONG slot, DWORD flags);
+		/** Posts a deferred send of bytes already copied to the ring, started by commitSends. */
+		int postSend(ULONG offset, ULONG size);
+		int commitSends();
+		/** Leaves the completion queue and releases the registered memory, once the socket is closed. */
+		void unregister();
+	};
+}
@@ -0,0 +1,124 @@
+#include "RioCompletionQueue.hpp"
+#include <algorithm>
+
+
+namespace Communication
+{
+	/** Completions the queue holds before it has to grow. */
+	constexpr ULONG initialCapacity = 1024;
+	/** Completions taken by one RIODequeueCompletion. */
+	constexpr ULONG maxResults = 128;
+
+	RioCompletionQueue::~RioCompletionQueue()
+	{
+		if (queue != RIO_INVALID_CQ)
+			rio.RIOCloseCompletionQueue(queue);
+		if (event != nullptr)
+			CloseHandle(event);
+	}
+
+	int RioCompletionQueue::open(SOCKET socket)
+	{
+		GUID functionsId = WSAID_MULTIPLE_RIO;
+		DWORD returned = 0;
+		rio.cbSize = sizeof(rio);
+		if (WSAIoctl(socket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &functionsId, sizeof(functionsId),
+			&rio, sizeof(rio), &returned, nullptr, nullptr) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Registered I/O nu este disponibil, error = ", error);
+			return error;
+		}
+
+		event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		if (event == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut crea evenimentul cozii de completari, error = ", error);
+			return error;
+		}
+		RIO_NOTIFICATION_COMPLETION notification = {};
+		notification.Type = RIO_EVENT_COMPLETION;
+		notification.Event.EventHandle = event;
+		notification.Event.NotifyReset = TRUE;
+		queue = rio.RIOCreateCompletionQueue(initialCapacity, &notification);
+		if (queue == RIO_INVALID_CQ)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut crea coada de completari, error = ", error);
+			return error;
+		}
+		capacity = initialCapacity;
+		return ERROR_SUCCESS;
+	}
+
+	int RioCompletionQueue::attach(Connection* connection, ULONG requests, ULONG_PTR& id)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if (reserved + requests > capacity)
+		{
+			const ULONG grown = std::max(2 * capacity, reserved + requests);
+			if (!rio.RIOResizeCompletionQueue(queue, grown))
+			{
+				int error = WSAGetLastError();
+				_log_("Coada de completari nu a putut creste la ", grown, ", error = ", error);
+				return error;
+			}
+			capacity = grown;
+		}
+		reserved += requests;
+		id = nextId++;
+		connections[id] = connection;
+		return ERROR_SUCCESS;
+	}
+
+	void RioCompletionQueue::detach(ULONG_PTR id, ULONG requests)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		connections.erase(id);
+		reserved -= requests;
+	}
+
+	void RioCompletionQueue::dequeue()
+	{
+		RIORESULT results[maxResults];
+		for (;;)
+		{
+			const ULONG count = rio.RIODequeueCompletion(queue, results, maxResults);
+			if (count == RIO_CORRUPT_CQ)
+				exitWithError("Coada de completari Registered I/O este corupta.");
+			for (ULONG i = 0; i < count; i++)
+				if (auto found = connections.find(ULONG_PTR(results[i].SocketContext)); found != connections.end())
+					found->second->completed(ULONG_PTR(results[i].RequestContext), results[i].Status, results[i].BytesTransferred);
+			if (count < maxResults)
+				return;
+		}
+	}
+
+	int RioCompletionQueue::wait(HANDLE other, int timeout, bool& woken)
+	{
+		{
+			// The event is set at once if completions are already queued
+			std::lock_guard<std::mutex> guard(mutex);
+			const int error = rio.RIONotify(queue);
+			if (error != ERROR_SUCCESS && error != WSAEALREADY)
+			{
+				_log_("Apelul RIONotify a intors eroarea ", error);
+				return error;
+			}
+		}
+
+		HANDLE events[] = { event, other };
+		const DWORD result = WaitForMultipleObjects(other != nullptr ? 2 : 1, events, FALSE, timeout < 0 ? INFINITE : DWORD(timeout));
+		if (result == WAIT_FAILED)
+		{
+			int error = GetLastError();
+			_log_("Asteptarea completarilor a esuat, error = ", error);
+			return error;
+		}
+		if (result == WAIT_TIMEOUT)
+			return WSAETIMEDOUT;
+		woken = result == WAIT_OBJECT_0 + 1;
+		return ERROR_SUCCESS;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Socket.hpp"
+#include <mswsock.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace Communication
+{
+	/**
+	 * Registered I/O completion queue shared by the connections of a server: one RIODequeueCompletion, without a
+	 * system call, collects the finished sends and receives of all of them, and one RIONotify waits for any of them.
+	 * The queue, and the request queues of its connections, are used under lock().
+	 */
+	class RioCompletionQueue
+	{
+	public:
+		/** Gets the completions of its requests, under lock(). */
+		class Connection
+		{
+		public:
+			virtual ~Connection() = default;
+			virtual void completed(ULONG_PTR request, LONG status, ULONG bytes) = 0;
+		};
+
+	private:
+		RIO_EXTENSION_FUNCTION_TABLE rio = {};
+		RIO_CQ queue = RIO_INVALID_CQ;
+		HANDLE event = nullptr;					// Set by RIONotify
+		ULONG capacity = 0, reserved = 0;		// Completions the queue holds, completions its connections may have
+		std::unordered_map<ULONG_PTR, Connection *> connections;		// By the socket context of their requests
+		ULONG_PTR nextId = 1;
+		std::mutex mutex;
+
+	public:
+		RioCompletionQueue() = default;
+		~RioCompletionQueue();
+		RioCompletionQueue(const RioCompletionQueue&) = delete;
+		void operator =(const RioCompletionQueue&) = delete;
+
+		/** Loads the Registered I/O functions through socket and creates the queue, fails where they do not exist. */
+		int open(SOCKET socket);
+		const RIO_EXTENSION_FUNCTION_TABLE& functions() const { return rio; }
+		RIO_CQ getHandle() const { return queue; }
+		std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(mutex); }
+
+		/** Makes room for the completions of a connection with at most requests outstanding; id is the socket context of its requests. */
+		int attach(Connection* connection, ULONG requests, ULONG_PTR& id);
+		/** The completions that still arrive for the connection are dropped. */
+		void detach(ULONG_PTR id, ULONG requests);
+
+		/** Hands the completions of all the connections to them, under lock(). */
+		void dequeue();
+		/** Waits, not under lock(), for a completion or for other, at most timeout milliseconds (-1 is infinite). */
+		int wait(HANDLE other, int timeout, bool& woken);
+	};
+}
@@ -5,9 +5,14 @@
 #include <vector>
 #include <stack>
 #include <map>
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+#include <tuple>
 #include "Traits.hpp"
 #include "ScopeGuard.hpp"
 #include "Buffer.hpp"
+#include "WorkerPool.hpp"
 
 
 namespace Communication
@@ -27,9 +32,44 @@ template<typename Type> struct Serializer
 	}
 };
 
+/**
+ * Opt-in columnar layout for std::vector<Type>: each field is sent as one column with the values of all the records.
+ * Specialize it with the fields of the record, for example:
+ *     template<> struct Columns<Point>
+ *     {
+ *         static constexpr auto fields = std::make_tuple(Communication::column("x", &Point::x), Communication::column("name", &Point::name));
+ *     };
+ * The vectors of such records do not use Serializer<Type>, see Communication::ColumnarSerializer.
+ */
+template<typename Type> struct Columns
+{
+};
+
 
 namespace Communication
 {
+	/** A field of a record, see Columns. */
+	template<typename Record, typename Field> struct Column
+	{
+		const char* name;
+		Field Record::* member;
+	};
+	template<typename Record, typename Field> constexpr Column<Record, Field> column(const char* name, Field Record::* member)
+	{
+		return Column<Record, Field>{ name, member };
+	}
+
+	template<typename Type, typename = void> struct has_columns
+	{
+		static const bool value = false;
+	};
+	template<typename Type> struct has_columns<Type, std::void_t<decltype(::Columns<Type>::fields)>>
+	{
+		static const bool value = true;
+	};
+
+	template<typename Record> struct ColumnarSerializer;
+
 	// Primary template
 	template<typename Type, GeneralType generalType = getGeneralType<Type>()>
 	struct BasicSerializer
@@ -42,6 +82,10 @@ namespace Communication
 		{
 			static_assert(!std::is_same<Type, Type>::value, "Class specialization needed.");
 		}
+		static void deserializeInto(const Buffer& buffer, Type& value)
+		{
+			static_assert(!std::is_same<Type, Type>::value, "Class specialization needed.");
+		}
 	};
 
 	template<typename Type, GeneralType generalType = getGeneralType<Type>()>
@@ -59,19 +103,9 @@ namespace Communication
 				return data;
 			}
 		}
-		static Type deserialize(const Buffer& buffer)
-		{
-			if constexpr (getGeneralType<Type>() != GeneralType::CustomType)
-				return BasicSerializer<Type>::deserialize(buffer);
-			else
-			{
-				SerializedData data(buffer);
-				Serializer<Type> serializer;
-				Type object;
-				serializer.deserialize(data, object);
-				return object;
-			}
-		}
+		static Type deserialize(const Buffer& buffer);
+		/** Deserializes into an existing object, reusing the memory it already holds (e.g. vector and string capacity). */
+		static void deserializeInto(const Buffer& buffer, Type& value);
 	};
 
 
@@ -80,9 +114,25 @@ namespace Communication
 	// ----------------------------------------------------------------------------
 
 
+	/**
+	 * Named fields, sent as a Custom buffer of (name, value) pairs sorted by name.
+	 * Data read from a buffer is lazy: the frame is scanned once into an index of the fields, which are
+	 * decoded only when they are read. As long as no field is added or removed, the frame is forwarded
+	 * as it was received, without being encoded again.
+	 */
 	class SerializedData
 	{
-		std::map<std::string, Buffer> parts;		// Map with key = name and value = buffer
+		struct IndexedField
+		{
+			std::string_view name;		// Points into the frame
+			size_t offset;				// Of the name buffer, the value buffer follows it
+			bool removed;
+		};
+
+		std::map<std::string, Buffer> parts;		// Map with key = name and value = buffer, for the added fields
+		Buffer frame;								// The buffer the data was read from, if any
+		std::vector<IndexedField> index;			// Fields of the frame, sorted by name
+		bool changed = false;						// Fields were added or removed since the frame was read
 
 	public:
 		//
@@ -91,81 +141,234 @@ namespace Communication
 		// Default template class
 		SerializedData() = default;
 		SerializedData(const Buffer& buffer)
+			: frame(buffer)
 		{
-			assert(buffer.getType() == Buffer::BufferType::Custom, "Eroare la deserializare - nu se deserializeaza un tip custom.");
-			std::vector<Buffer> buffers = Buffer::unpackBuffer(buffer);
-			assert(buffers.size() % 2 == 0, "Eroare la deserializare - tipul custom nu este serializat corect.");
-			for (size_t i = 0; i < buffers.size(); i += 2)
-			{
-				Buffer& nameBuffer = buffers[i];
-				Buffer& data = buffers[i + 1];
+			buildIndex();
+		}
+		SerializedData(Buffer&& buffer)
+			: frame(std::move(buffer))
+		{
+			buildIndex();
+		}
+		SerializedData(const SerializedData& other)
+			: parts(other.parts)
+			, frame(other.frame)
+			, index(other.index)
+			, changed(other.changed)
+		{
+			// The names point into the copied frame
+			const char* oldStart = static_cast<const char *>(static_cast<const void *>(other.frame));
+			const char* newStart = static_cast<const char *>(static_cast<const void *>(frame));
+			for (IndexedField& field : index)
+				field.name = std::string_view(newStart + (field.name.data() - oldStart), field.name.size());
+		}
+		SerializedData(SerializedData&&) = default;
+		void operator =(const SerializedData&) = delete;
+		SerializedData& operator =(SerializedData&&) = default;
 
-				assert(nameBuffer.getType() == Buffer::BufferType::String, "Nu se poate deserializa - cheile nu sunt stringuri.");
-				std::string name = static_cast<const char *>(nameBuffer.getData());
-				parts.emplace(name, std::move(data));
-			}
+		/** Reads the fields of a buffer that outlives the data, the frame is not copied. */
+		static SerializedData view(const Buffer& buffer)
+		{
+			SerializedData data;
+			data.frame = Buffer::view(buffer);
+			data.buildIndex();
+			return data;
 		}
 
 		template<class Type> void add(const std::string& name, const Type& object)
 		{
-			assert(parts.count(name) == 0, "Exista deja un element cu cheia \"", name, "\".");
+			assert(!contains(name), "Exista deja un element cu cheia \"", name, "\".");
 			parts.emplace(name, SerializerSelector<remove_reference_and_const<Type>::type>::serialize(object));
+			changed = true;
 		}
 		template<class Type> bool extract(const std::string& name, Type& object)
 		{
-			auto it = _get<remove_reference_and_const<Type>::type>(name, object);
-			if (it == parts.end())
+			if (!peek(name, object))
 				return false;
-			parts.erase(it);
+			remove(name);
 			return true;
 		}
 		template<class Type> bool peek(const std::string& name, Type& object) const
 		{
-			auto it = _get<remove_reference_and_const<Type>::type>(name, object);
-			if (it == parts.end())
+			const Buffer* buffer = nullptr;
+			Buffer value;
+			if (!_get(name, buffer, value))
 				return false;
+			SerializerSelector<remove_reference_and_const<Type>::type>::deserializeInto(*buffer, object);
 			return true;
 		}
 		operator Buffer()
 		{
+			if (!changed && frame.getSize() != 0)
+				return Buffer(frame);
+
+			// The added fields and the ones left from the frame, merged in the order of their names
+			std::vector<Buffer> views;
+			views.reserve(2 * index.size());
 			std::vector<const Buffer *> buffers;
 			std::stack<std::unique_ptr<Buffer>> names;
+			auto field = index.begin();
+			auto addIndexedUntil = [&](const std::string* name)
+			{
+				for (; field != index.end() && (name == nullptr || field->name < *name); ++field)
+					if (!field->removed)
+					{
+						views.push_back(Buffer::view(static_cast<const char *>(static_cast<const void *>(frame)) + field->offset));
+						buffers.push_back(&views.back());
+						views.push_back(Buffer::view(static_cast<const char *>(static_cast<const void *>(frame)) + field->offset + views.back().getSize()));
+						buffers.push_back(&views.back());
+					}
+			};
 			for (auto& pair : parts)
 			{
+				addIndexedUntil(&pair.first);
 				names.push(std::unique_ptr<Buffer>(new Buffer(pair.first)));
 				buffers.push_back(names.top().get());
 				buffers.push_back(&pair.second);
 			}
+			addIndexedUntil(nullptr);
 			return Buffer::packBuffers(buffers);
 		}
 
+		/** The frame the data was read from, nullptr if fields were added or removed since then. */
+		const Buffer* getFrame() const
+		{
+			return !changed && frame.getSize() != 0 ? &frame : nullptr;
+		}
+
 		void addBuffer(const std::string& name, Buffer&& buffer)
 		{
+			assert(!contains(name), "Exista deja un element cu cheia \"", name, "\".");
+			assert(buffer.getSize() != 0, "Elementul cu cheia \"", name, "\" este un buffer gol, fara header.");
 			parts.emplace(name, std::move(buffer));
+			changed = true;
+		}
+		/** The field as a view, nothing is copied; valid while the frame (or the added buffer) is alive and unchanged. */
+		bool viewBuffer(const std::string& name, Buffer& view) const
+		{
+			const Buffer* buffer = nullptr;
+			Buffer value;
+			if (!_get(name, buffer, value))
+				return false;
+			view = Buffer::view(*buffer);
+			return true;
 		}
 		bool removeBuffer(const std::string& name, Buffer& buffer)
 		{
 			auto it = parts.find(name);
-			if (it == parts.end())
-				return false;
+			if (it != parts.end())
+			{
+				buffer = std::move(it->second);
+				parts.erase(it);
+				changed = true;
+				return true;
+			}
 
-			buffer = std::move(it->second);
-			parts.erase(it);
+			IndexedField* field = findIndexed(name);
+			if (field == nullptr)
+				return false;
+			const char* nameBuffer = static_cast<const char *>(static_cast<const void *>(frame)) + field->offset;
+			const Buffer value = Buffer::view(nameBuffer + Buffer::view(nameBuffer).getSize());
+			void* storage = buffer.getStorage(value.getSize());
+			assert(storage != nullptr, "Eroare la alocare memorie de ", value.getSize(), " bytes.");
+			std::memcpy(storage, value, value.getSize());
+			buffer.adoptStorage();
+			field->removed = true;
+			changed = true;
 			return true;
 		}
 
+		bool contains(const std::string& name) const
+		{
+			return parts.count(name) != 0 || const_cast<SerializedData *>(this)->findIndexed(name) != nullptr;
+		}
+
 	private:
-		template<class Type> decltype(parts)::const_iterator _get(const std::string& name, Type& object) const
+		/** Scans the frame once, only the positions of the fields are recorded. */
+		void buildIndex()
+		{
+			assert(frame.getType() == Buffer::BufferType::Custom, "Eroare la deserializare - nu se deserializeaza un tip custom.");
+			const char* start = static_cast<const char *>(static_cast<const void *>(frame));
+			const char* name = nullptr;
+			Buffer::forEachPart(frame, [this, start, &name](const Buffer& part)
+			{
+				if (name == nullptr)
+				{
+					assert(part.getType() == Buffer::BufferType::String && part.getDataSize() >= 1, "Nu se poate deserializa - cheile nu sunt stringuri.");
+					name = static_cast<const char *>(static_cast<const void *>(part));
+					index.push_back(IndexedField{ std::string_view(static_cast<const char *>(part.getData()), part.getDataSize() - 1), size_t(name - start), false });
+				}
+				else
+					name = nullptr;
+			});
+			assert(name == nullptr, "Eroare la deserializare - tipul custom nu este serializat corect.");
+
+			// Frames built by SerializedData are already sorted
+			if (!std::is_sorted(index.begin(), index.end(), [](const IndexedField& a, const IndexedField& b) { return a.name < b.name; }))
+				std::sort(index.begin(), index.end(), [](const IndexedField& a, const IndexedField& b) { return a.name < b.name; });
+		}
+
+		IndexedField* findIndexed(const std::string& name)
+		{
+			auto it = std::lower_bound(index.begin(), index.end(), std::string_view(name), [](const IndexedField& field, std::string_view name) { return field.name < name; });
+			if (it == index.end() || it->name != name || it->removed)
+				return nullptr;
+			return &*it;
+		}
+
+		void remove(const std::string& name)
+		{
+			if (parts.erase(name) == 0)
+				findIndexed(name)->removed = true;
+			changed = true;
+		}
+
+		/** Finds the buffer of a field, indexed fields are viewed in place through value. */
+		bool _get(const std::string& name, const Buffer*& buffer, Buffer& value) const
 		{
 			auto it = parts.find(name);
-			if (it == parts.end())
-				return parts.end();
+			if (it != parts.end())
+			{
+				buffer = &it->second;
+				return true;
+			}
 
-			object = SerializerSelector<Type>::deserialize(it->second);
-			return it;
+			const IndexedField* field = const_cast<SerializedData *>(this)->findIndexed(name);
+			if (field == nullptr)
+				return false;
+			const char* nameBuffer = static_cast<const char *>(static_cast<const void *>(frame)) + field->offset;
+			value = Buffer::view(nameBuffer + Buffer::view(nameBuffer).getSize());
+			buffer = &value;
+			return true;
 		}
 	};
 
+	// Defined after SerializedData, custom types are read in place through SerializedData::view without copying the frame
+	template<typename Type, GeneralType generalType> Type SerializerSelector<Type, generalType>::deserialize(const Buffer& buffer)
+	{
+		if constexpr (getGeneralType<Type>() != GeneralType::CustomType)
+			return BasicSerializer<Type>::deserialize(buffer);
+		else
+		{
+			SerializedData data = SerializedData::view(buffer);
+			Serializer<Type> serializer;
+			Type object;
+			serializer.deserialize(data, object);
+			return object;
+		}
+	}
+	template<typename Type, GeneralType generalType> void SerializerSelector<Type, generalType>::deserializeInto(const Buffer& buffer, Type& value)
+	{
+		if constexpr (getGeneralType<Type>() != GeneralType::CustomType)
+			BasicSerializer<Type>::deserializeInto(buffer, value);
+		else
+		{
+			SerializedData data = SerializedData::view(buffer);
+			Serializer<Type> serializer;
+			serializer.deserialize(data, value);
+		}
+	}
+
 
 	// ----------------------------------------------------------------------------
 	// ----------------------------------------------------------------------------
@@ -183,6 +386,13 @@ namespace Communication
 		{
 			return Buffer(buffer);
 		}
+		static void deserializeInto(const Buffer& buffer, Buffer& value)
+		{
+			void* storage = value.getStorage(buffer.getSize());
+			assert(storage != nullptr, "Eroare la alocare memorie de ", buffer.getSize(), " bytes.");
+			std::memcpy(storage, buffer, buffer.getSize());
+			value.adoptStorage();
+		}
 	};
 
 	// Fundamental type specialization
@@ -195,7 +405,11 @@ namespace Communication
 		static Type deserialize(const Buffer& buffer)
 		{
 			assert(buffer.getType() == Buffer::TypeEnumFromTypeName<Type>::value, "Eroare la deserializare - tipul de deserializat nu e acelasi cu cel din buffer.");
-			return *reinterpret_cast<const Type *>(buffer.getData());
+			return buffer.getValue<Type>();
+		}
+		static void deserializeInto(const Buffer& buffer, Type& value)
+		{
+			value = deserialize(buffer);
 		}
 	};
 
@@ -209,9 +423,18 @@ namespace Communication
 			return Buffer(value);
 		}
 		static StringType deserialize(const Buffer& buffer)
+		{
+			StringType result;
+			deserializeInto(buffer, result);
+			return result;
+		}
+		static void deserializeInto(const Buffer& buffer, StringType& value)
 		{
 			assert(buffer.getType() == Buffer::TypeEnumFromTypeName<std::basic_string<CharType>>::value, "Eroare la deserializare - tipul de deserializat nu e acelasi cu cel din buffer.");
-			return StringType(static_cast<const CharType *>(buffer.getData()));
+			const size_t length = buffer.getDataSize() / Endian::wireSize<CharType>();
+			assert(length >= 1, "Eroare la deserializare - sirul nu are terminator.");
+			value.resize(length - 1);
+			Endian::fromWire(buffer.getData(), length - 1, &value[0]);
 		}
 	};
 
@@ -225,51 +448,424 @@ namespace Communication
 			return Buffer::packBuffers({ &buffer1, &buffer2 });
 		}
 		static std::pair<Type1, Type2> deserialize(const Buffer& buffer)
+		{
+			std::pair<Type1, Type2> result;
+			deserializeInto(buffer, result);
+			return result;
+		}
+		static void deserializeInto(const Buffer& buffer, std::pair<Type1, Type2>& value)
 		{
 			assert(buffer.getType() == Buffer::BufferType::Custom, "Eroare la deserializare - tipul de deserializat nu e custom.");
-			std::vector<Buffer> parts = Buffer::unpackBuffer(buffer);
-			assert(parts.size() == 2, "Eroare la deserializare - nu s-a deserializat o pereche.");
-			assert(parts[0].getType() == Buffer::TypeEnumFromTypeName<Type1>::value, "Eroare la deserializare - primul tip din pereche nu coincide cu cel din buffer.");
-			assert(parts[1].getType() == Buffer::TypeEnumFromTypeName<Type2>::value, "Eroare la deserializare - al doilea tip din pereche nu coincide cu cel din buffer.");
-			return std::pair<Type1, Type2>(SerializerSelector<Type1>::deserialize(parts[0]), SerializerSelector<Type2>::deserialize(parts[1]));
+			// The type of each part is checked by its own serializer, which knows all its encodings (a vector is an Array or Columns too)
+			size_t index = 0;
+			Buffer::forEachPart(buffer, [&value, &index](const Buffer& part)
+			{
+				if (index == 0)
+					SerializerSelector<Type1>::deserializeInto(part, value.first);
+				else if (index == 1)
+					SerializerSelector<Type2>::deserializeInto(part, value.second);
+				index++;
+			});
+			assert(index == 2, "Eroare la deserializare - nu s-a deserializat o pereche.");
 		}
 	};
 
-	// Vector specialization
+	/** Elements of a vector encoded or decoded by one thread, smaller vectors are done by the caller alone. */
+	constexpr size_t parallelSerializationRange = 4096;
+	/** Bytes of an Array converted to the wire format before they are hashed, small enough to stay in the L1 cache. */
+	constexpr size_t hashBlockSize = 16 * 1024;
+
+	/**
+	 * Vector specialization.
+	 * Large vectors of non-fundamental elements are split in ranges done by the threads of WorkerPool::shared(),
+	 * so the serializers of the elements (Serializer<Type>) must not share state between calls.
+	 */
 	template<typename Type> struct BasicSerializer<std::vector<Type>, GeneralType::CustomImplementedType>
 	{
 		static Buffer serialize(const std::vector<Type>& value) noexcept
 		{
-			std::vector<const Buffer *> elementBuffers;
-			elementBuffers.push_back(new Buffer(BasicSerializer<size_t>::serialize(value.size())));
-			ScopeGuard deleteTempBuffers([&elementBuffers]
+			if constexpr (std::is_same<Type, bool>::value)
 			{
-				for (const Buffer* buf : elementBuffers)
-					delete buf;
-			});
+				// std::vector<bool> has no contiguous storage
+				std::unique_ptr<bool[]> values(new bool[value.size()]);
+				std::copy(value.begin(), value.end(), values.get());
+				return serializeRange(values.get(), value.size());
+			}
+			else
+				return serializeRange(value.data(), value.size());
+		}
+		/**
+		 * Serializes count elements starting at first, the result deserializes as a std::vector<Type>.
+		 * The optional hasher receives the bytes of the result as they are written.
+		 */
+		static Buffer serializeRange(const Type* first, size_t count, Hasher* hasher = nullptr) noexcept
+		{
+			if constexpr (has_columns<Type>::value)
+				return ColumnarSerializer<Type>::serializeRange(first, count, hasher);
+			else if constexpr (getGeneralType<Type>() == GeneralType::FundamentalType && !std::is_same<Type, bool>::value)
+				return serializeArray(first, count, hasher);
+			else
+			{
+				WorkerPool& pool = WorkerPool::shared();
+				if (const size_t rangeCount = pool.getRangeCount(count, parallelSerializationRange); rangeCount > 1)
+					return serializeParallel(first, count, pool, rangeCount, hasher);
 
-			for (auto& elem : value)
-				elementBuffers.push_back(new Buffer(SerializerSelector<Type>::serialize(elem)));
-			Buffer result = Buffer::packBuffers(elementBuffers, Buffer::BufferType::Vector);
+				std::vector<const Buffer *> elementBuffers;
+				elementBuffers.push_back(new Buffer(BasicSerializer<size_t>::serialize(count)));
+				ScopeGuard deleteTempBuffers([&elementBuffers]
+				{
+					for (const Buffer* buf : elementBuffers)
+						delete buf;
+				});
 
-			return result;
+				for (size_t i = 0; i < count; i++)
+					elementBuffers.push_back(new Buffer(SerializerSelector<Type>::serialize(first[i])));
+				Buffer result = Buffer::packBuffers(elementBuffers, Buffer::BufferType::Vector, hasher);
+
+				return result;
+			}
 		}
 		static std::vector<Type> deserialize(const Buffer& buffer)
 		{
-			assert(buffer.getType() == Buffer::BufferType::Vector, "Eroare la deserializare - tipul de deserializat nu e vector.");
-			std::vector<Buffer> parts = Buffer::unpackBuffer(buffer);
-			assert(parts.size() >= 1, "Eroare la deserializare - vectorul nu este serializat corect.");
-			assert(parts[0].getType() == Buffer::BufferType::Size_T, "Eroare la deserializare - vectorul nu este serializat corect.");
-			decltype(parts.size()) size = BasicSerializer<size_t>::deserialize(parts[0]);
-			assert(parts.size() - 1 == size, "Eroare la deserializare - vectorul nu este serializat corect.");
-
 			std::vector<Type> result;
-			result.reserve(size);
-			for (auto i = 1; i < 1 + size; i++)
-				result.push_back(SerializerSelector<Type>::deserialize(parts[i]));
-
+			deserializeInto(buffer, result);
 			return result;
 		}
+		/** The elements already in value are overwritten in place, so their memory is reused too. */
+		static void deserializeInto(const Buffer& buffer, std::vector<Type>& value)
+		{
+			if constexpr (has_columns<Type>::value)
+				ColumnarSerializer<Type>::deserializeInto(buffer, value);
+			else
+			{
+				if constexpr (getGeneralType<Type>() == GeneralType::FundamentalType && !std::is_same<Type, bool>::value)
+					if (buffer.getType() == Buffer::BufferType::Array)
+						return deserializeArray(buffer, value);
+
+				assert(buffer.getType() == Buffer::BufferType::Vector, "Eroare la deserializare - tipul de deserializat nu e vector.");
+				if constexpr (!std::is_same<Type, bool>::value)		// The elements of std::vector<bool> share bytes
+					if (deserializeParallel(buffer, value))
+						return;
+
+				size_t index = 0;
+				Buffer::forEachPart(buffer, [&value, &index](const Buffer& part)
+				{
+					if (index == 0)
+					{
+						assert(part.getType() == Buffer::BufferType::Size_T, "Eroare la deserializare - vectorul nu este serializat corect.");
+						value.resize(BasicSerializer<size_t>::deserialize(part));
+					}
+					else
+					{
+						assert(index <= value.size(), "Eroare la deserializare - vectorul nu este serializat corect.");
+						if constexpr (std::is_same<Type, bool>::value)
+							value[index - 1] = BasicSerializer<bool>::deserialize(part);
+						else
+							SerializerSelector<Type>::deserializeInto(part, value[index - 1]);
+					}
+					index++;
+				});
+				assert(index >= 1 && index - 1 == value.size(), "Eroare la deserializare - vectorul nu este serializat corect.");
+			}
+		}
+
+	private:
+		/**
+		 * Every range of elements is encoded by a thread into buffers of its own. The prefix sums of the sizes of the
+		 * ranges give their offsets in the frame, so each thread then copies its buffers straight to their place.
+		 * The frame is the same as the one encoded by a single thread. As with packBuffers, every element costs an
+		 * allocation and its bytes are copied once more: the serializers only make whole buffers, none tells the size
+		 * of an element before encoding it.
+		 */
+		static Buffer serializeParallel(const Type* first, size_t count, WorkerPool& pool, size_t rangeCount, Hasher* hasher)
+		{
+			std::vector<std::vector<Buffer>> rangeBuffers(rangeCount);
+			std::vector<size_t> offsets(rangeCount + 1);
+			pool.forEachRange(rangeCount, count, [first, &rangeBuffers, &offsets](size_t range, size_t begin, size_t end)
+			{
+				std::vector<Buffer>& buffers = rangeBuffers[range];
+				buffers.reserve(end - begin);
+				size_t size = 0;
+				for (size_t i = begin; i < end; i++)
+				{
+					buffers.push_back(SerializerSelector<Type>::serialize(first[i]));
+					size += buffers.back().getSize();
+				}
+				offsets[range + 1] = size;
+			});
+
+			const Buffer countBuffer = BasicSerializer<size_t>::serialize(count);
+			offsets[0] = countBuffer.getSize();
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+			const size_t dataSize = offsets.back();
+			const size_t headerSize = Buffer::getHeaderSize(dataSize);
+			char* bytes = static_cast<char *>(std::malloc(headerSize + dataSize));
+			assert(bytes != nullptr, "Eroare la alocare memorie de ", headerSize + dataSize, " bytes.");
+
+			Buffer::writeHeader(bytes, Buffer::BufferType::Vector, dataSize);
+			std::memcpy(bytes + headerSize, countBuffer, countBuffer.getSize());
+			if (hasher != nullptr)
+				hasher->update(bytes, headerSize + countBuffer.getSize());
+
+			// Every range is hashed by the thread that copied it, while still in its cache, and after the range before it,
+			// so the digest is the one of the whole frame; the ranges are taken in order, the one waited for is in progress
+			size_t hashedRanges = 0;
+			std::mutex hashMutex;
+			std::condition_variable rangeHashed;
+			pool.forEachRange(rangeCount, count, [bytes, headerSize, hasher, &rangeBuffers, &offsets, &hashedRanges, &hashMutex, &rangeHashed](size_t range, size_t, size_t)
+			{
+				char* destination = bytes + headerSize + offsets[range];
+				for (const Buffer& buffer : rangeBuffers[range])
+				{
+					std::memcpy(destination, buffer, buffer.getSize());
+					destination += buffer.getSize();
+				}
+				std::vector<Buffer>().swap(rangeBuffers[range]);
+				if (hasher == nullptr)
+					return;
+
+				std::unique_lock<std::mutex> lock(hashMutex);
+				rangeHashed.wait(lock, [&hashedRanges, range] { return hashedRanges == range; });
+				hasher->update(bytes + headerSize + offsets[range], offsets[range + 1] - offsets[range]);
+				hashedRanges++;
+				rangeHashed.notify_all();
+			});
+			return Buffer(std::move(static_cast<void *>(bytes)));
+		}
+
+		/**
+		 * Decodes the ranges of a large vector on the threads of the pool, false if the vector is too small for it.
+		 * Only the headers of the elements are read to index where each range starts, then every thread decodes its range.
+		 */
+		static bool deserializeParallel(const Buffer& buffer, std::vector<Type>& value)
+		{
+			const char* frame = static_cast<const char *>(static_cast<const void *>(buffer));
+			size_t offset = buffer.getHeaderSize();
+			assert(offset < buffer.getSize(), "Eroare la deserializare - vectorul nu este serializat corect.");
+			const Buffer countBuffer = Buffer::view(frame + offset);
+			assert(countBuffer.getType() == Buffer::BufferType::Size_T, "Eroare la deserializare - vectorul nu este serializat corect.");
+			const size_t count = BasicSerializer<size_t>::deserialize(countBuffer);
+			WorkerPool& pool = WorkerPool::shared();
+			const size_t rangeCount = pool.getRangeCount(count, parallelSerializationRange);
+			if (rangeCount == 1)
+				return false;
+
+			std::vector<size_t> rangeOffsets;
+			rangeOffsets.reserve(rangeCount);
+			offset += countBuffer.getSize();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (i == WorkerPool::getRangeStart(rangeOffsets.size(), rangeCount, count))
+					rangeOffsets.push_back(offset);
+				Buffer::BufferType type;
+				size_t dataSize = 0;
+				const size_t headerSize = Buffer::readHeader(frame + offset, buffer.getSize() - offset, type, dataSize);
+				assert(headerSize != 0 && dataSize <= buffer.getSize() - offset - headerSize, "Eroare la deserializare - vectorul nu este serializat corect.");
+				offset += headerSize + dataSize;
+			}
+			assert(offset == buffer.getSize(), "Eroare la deserializare - vectorul nu este serializat corect.");
+
+			value.resize(count);
+			pool.forEachRange(rangeCount, count, [frame, &rangeOffsets, &value](size_t range, size_t begin, size_t end)
+			{
+				size_t offset = rangeOffsets[range];
+				for (size_t i = begin; i < end; i++)
+				{
+					const Buffer part = Buffer::view(frame + offset);
+					offset += part.getSize();
+					SerializerSelector<Type>::deserializeInto(part, value[i]);
+				}
+			});
+			return true;
+		}
+
+		/** Vectors of fundamental values are sent as Arrays, converted to the wire format all at once. */
+		static Buffer serializeArray(const Type* first, size_t count, Hasher* hasher)
+		{
+			const size_t dataSize = 1 + count * Endian::wireSize<Type>();
+			const size_t headerSize = Buffer::getHeaderSize(dataSize);
+			unsigned char* bytes = static_cast<unsigned char *>(std::malloc(headerSize + dataSize));
+			assert(bytes != nullptr, "Eroare la alocare memorie de ", headerSize + dataSize, " bytes.");
+
+			Buffer::writeHeader(bytes, Buffer::BufferType::Array, dataSize);
+			bytes[headerSize] = static_cast<unsigned char>(Buffer::TypeEnumFromTypeName<Type>::value);
+			if (hasher == nullptr)
+			{
+				Endian::toWire(first, count, bytes + headerSize + 1);
+				return Buffer(std::move(static_cast<void *>(bytes)));
+			}
+
+			// Converted in blocks, each hashed while still in the cache
+			hasher->update(bytes, headerSize + 1);
+			const size_t blockCount = std::max<size_t>(1, hashBlockSize / Endian::wireSize<Type>());
+			for (size_t i = 0; i < count; i += blockCount)
+			{
+				unsigned char* block = bytes + headerSize + 1 + i * Endian::wireSize<Type>();
+				const size_t elements = std::min(blockCount, count - i);
+				Endian::toWire(first + i, elements, block);
+				hasher->update(block, elements * Endian::wireSize<Type>());
+			}
+			return Buffer(std::move(static_cast<void *>(bytes)));
+		}
+
+		/** Arrays (e.g. sent directly from a file) hold the elements in wire format, converted all at once. */
+		static void deserializeArray(const Buffer& buffer, std::vector<Type>& value)
+		{
+			const unsigned char* data = static_cast<const unsigned char *>(buffer.getData());
+			assert(buffer.getDataSize() >= 1 && Buffer::BufferType(data[0]) == Buffer::TypeEnumFromTypeName<Type>::value, "Eroare la deserializare - tipul elementelor din array nu coincide.");
+			const size_t byteCount = buffer.getDataSize() - 1;
+			assert(byteCount % Endian::wireSize<Type>() == 0, "Eroare la deserializare - array-ul nu contine un numar intreg de elemente.");
+
+			value.resize(byteCount / Endian::wireSize<Type>());
+			Endian::fromWire(data + 1, value.size(), value.data());
+		}
+	};
+
+	/** Views the column of a field in a vector of records serialized on columns, false if the records were sent without it. */
+	inline bool findColumn(const Buffer& buffer, std::string_view name, Buffer& column)
+	{
+		assert(buffer.getType() == Buffer::BufferType::Columns, "Eroare la deserializare - vectorul nu este serializat pe coloane.");
+		const char* frame = static_cast<const char *>(static_cast<const void *>(buffer));
+		size_t offset = buffer.getHeaderSize();
+		offset += Buffer::view(frame + offset).getSize();		// The record count
+		while (offset < buffer.getSize())
+		{
+			const Buffer nameBuffer = Buffer::view(frame + offset);
+			assert(nameBuffer.getType() == Buffer::BufferType::String && nameBuffer.getDataSize() >= 1, "Nu se poate deserializa - numele coloanelor nu sunt stringuri.");
+			offset += nameBuffer.getSize();
+			assert(offset < buffer.getSize(), "Eroare la deserializare - coloana \"", static_cast<const char *>(nameBuffer.getData()), "\" lipseste.");
+			Buffer values = Buffer::view(frame + offset);
+			offset += values.getSize();
+			if (std::string_view(static_cast<const char *>(nameBuffer.getData()), nameBuffer.getDataSize() - 1) == name)
+			{
+				column = std::move(values);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Reads one column of a vector of records serialized on columns, e.g. into a structure of arrays.
+	 * Fundamental columns are converted all at once. False if the records were sent without the field.
+	 */
+	template<typename Field> bool readColumn(const Buffer& buffer, std::string_view name, std::vector<Field>& values)
+	{
+		Buffer column;
+		if (!findColumn(buffer, name, column))
+			return false;
+		BasicSerializer<std::vector<Field>>::deserializeInto(column, values);
+		return true;
+	}
+
+	/**
+	 * Vectors of records that declare their fields in Columns<Record>, sent as a Columns buffer: the record count,
+	 * then the name and the column of every field. A column has the format of a std::vector of the field, so the
+	 * fundamental fields are Arrays, contiguous values of one type, and any column can be read alone (see readColumn).
+	 * A field missing from the buffer keeps its value, so fields can be added to a record without breaking older peers.
+	 */
+	template<typename Record> struct ColumnarSerializer
+	{
+		static Buffer serializeRange(const Record* first, size_t count, Hasher* hasher)
+		{
+			std::vector<Buffer> parts;
+			parts.push_back(BasicSerializer<size_t>::serialize(count));
+			std::apply([first, count, &parts](const auto& ... columns)
+			{
+				(serializeColumn(first, count, columns, parts), ...);
+			}, ::Columns<Record>::fields);
+
+			std::vector<const Buffer *> buffers;
+			for (const Buffer& part : parts)
+				buffers.push_back(&part);
+			return Buffer::packBuffers(buffers, Buffer::BufferType::Columns, hasher);
+		}
+		static void deserializeInto(const Buffer& buffer, std::vector<Record>& value)
+		{
+			assert(buffer.getType() == Buffer::BufferType::Columns, "Eroare la deserializare - vectorul nu este serializat pe coloane.");
+			const Buffer countBuffer = Buffer::view(static_cast<const char *>(static_cast<const void *>(buffer)) + buffer.getHeaderSize());
+			assert(countBuffer.getType() == Buffer::BufferType::Size_T, "Eroare la deserializare - vectorul nu este serializat corect.");
+			value.resize(BasicSerializer<size_t>::deserialize(countBuffer));
+			std::apply([&buffer, &value](const auto& ... columns)
+			{
+				(deserializeColumn(buffer, columns, value), ...);
+			}, ::Columns<Record>::fields);
+		}
+
+	private:
+		/** Fields sent as Arrays, the others as Vectors of their serialized values. */
+		template<typename Field> static constexpr bool isArrayColumn()
+		{
+			return getGeneralType<Field>() == GeneralType::FundamentalType && !std::is_same<Field, bool>::value;
+		}
+
+		template<typename Field> static void serializeColumn(const Record* first, size_t count, const Column<Record, Field>& column, std::vector<Buffer>& parts)
+		{
+			parts.push_back(Buffer(std::string(column.name)));
+			if constexpr (isArrayColumn<Field>())
+			{
+				const size_t dataSize = 1 + count * Endian::wireSize<Field>();
+				const size_t headerSize = Buffer::getHeaderSize(dataSize);
+				unsigned char* bytes = static_cast<unsigned char *>(std::malloc(headerSize + dataSize));
+				assert(bytes != nullptr, "Eroare la alocare memorie de ", headerSize + dataSize, " bytes.");
+
+				Buffer::writeHeader(bytes, Buffer::BufferType::Array, dataSize);
+				bytes[headerSize] = static_cast<unsigned char>(Buffer::TypeEnumFromTypeName<Field>::value);
+				unsigned char* values = bytes + headerSize + 1;
+				for (size_t i = 0; i < count; i++)
+					Endian::toWire(&(first[i].*column.member), 1, values + i * Endian::wireSize<Field>());
+				parts.push_back(Buffer(std::move(static_cast<void *>(bytes))));
+			}
+			else
+			{
+				std::vector<Buffer> values;
+				values.reserve(count + 1);
+				values.push_back(BasicSerializer<size_t>::serialize(count));
+				for (size_t i = 0; i < count; i++)
+					values.push_back(SerializerSelector<Field>::serialize(first[i].*column.member));
+
+				std::vector<const Buffer *> buffers;
+				for (const Buffer& value : values)
+					buffers.push_back(&value);
+				parts.push_back(Buffer::packBuffers(buffers, Buffer::BufferType::Vector));
+			}
+		}
+
+		template<typename Field> static void deserializeColumn(const Buffer& buffer, const Column<Record, Field>& column, std::vector<Record>& records)
+		{
+			Buffer values;
+			if (!findColumn(buffer, column.name, values))
+				return;
+
+			if constexpr (isArrayColumn<Field>())
+			{
+				const unsigned char* data = static_cast<const unsigned char *>(values.getData());
+				assert(values.getType() == Buffer::BufferType::Array && values.getDataSize() >= 1 && Buffer::BufferType(data[0]) == Buffer::TypeEnumFromTypeName<Field>::value,
+					"Eroare la deserializare - tipul coloanei \"", column.name, "\" nu coincide.");
+				assert(values.getDataSize() - 1 == records.size() * Endian::wireSize<Field>(), "Eroare la deserializare - coloana \"", column.name, "\" nu are cate o valoare pentru fiecare inregistrare.");
+				for (size_t i = 0; i < records.size(); i++)
+					Endian::fromWire(data + 1 + i * Endian::wireSize<Field>(), 1, &(records[i].*column.member));
+			}
+			else
+			{
+				assert(values.getType() == Buffer::BufferType::Vector, "Eroare la deserializare - tipul coloanei \"", column.name, "\" nu coincide.");
+				size_t index = 0;
+				Buffer::forEachPart(values, [&column, &records, &index](const Buffer& part)
+				{
+					if (index == 0)
+					{
+						assert(part.getType() == Buffer::BufferType::Size_T && BasicSerializer<size_t>::deserialize(part) == records.size(),
+							"Eroare la deserializare - coloana \"", column.name, "\" nu are cate o valoare pentru fiecare inregistrare.");
+					}
+					else
+					{
+						assert(index <= records.size(), "Eroare la deserializare - coloana \"", column.name, "\" nu are cate o valoare pentru fiecare inregistrare.");
+						SerializerSelector<Field>::deserializeInto(part, records[index - 1].*column.member);
+					}
+					index++;
+				});
+			}
+		}
 	};
 
 	// Map specialization
@@ -11,7 +11,37 @@ namespace Communication
 
 		virtual int bind(int port) = 0;
 		virtual int listen(int clientCount) = 0;
+		/** The port the socket is bound to, the one picked by the system after bind(0); 0 if not bound. */
+		virtual int getPort() const = 0;
+		/** Returns nullptr on failure, see the overload below for the error. */
 		virtual ClientSocket* acceptClient() = 0;
+		/** Waits for a client and completes the handshake with it before the deadline, WSAETIMEDOUT otherwise. */
+		virtual int acceptClient(ClientSocket*& client, const Deadline& deadline) = 0;
 		virtual int close() = 0;
+		/** Thread-safe: wakes a blocked acceptClient, which returns ERROR_CANCELLED like every later one. */
+		virtual void cancel() = 0;
+
+		/** Calls ClientSocket::enableIntegrityCheck for the accepted clients. */
+		virtual void enableIntegrityCheck() = 0;
+		/** Calls ClientSocket::enableFlowControl for the accepted clients. */
+		virtual void enableFlowControl(size_t receiveWindow = Protocol::defaultReceiveWindow, size_t sendQueueLimit = Protocol::defaultSendQueueLimit) = 0;
+		/** Calls ClientSocket::enableChannels for the accepted clients. */
+		virtual void enableChannels(size_t sliceSize = Protocol::defaultSliceSize) = 0;
+		/** Calls ClientSocket::enableConcurrentSends for the accepted clients. */
+		virtual void enableConcurrentSends() = 0;
+		/** Calls ClientSocket::setMaxFrameSize for the accepted clients. */
+		virtual void setMaxFrameSize(size_t maxFrameSize) = 0;
+		/**
+		 * Calls ClientSocket::enableCapture for the accepted clients, each in its own file: path, a dot and the number of the client.
+		 * Fails if the file of the first client cannot be created.
+		 */
+		virtual int enableCapture(const std::string& path) = 0;
+		/**
+		 * Serves the accepted clients with Registered I/O: their transfers go through registered memory and one
+		 * completion queue shared by all of them, without a system call each. Several accepts stay posted, so
+		 * clients that connect together are not taken one by one. Falls back to regular sockets where Registered
+		 * I/O is not available. Call before listen.
+		 */
+		virtual void enableRegisteredIo() = 0;
 	};
 }
@@ -1,7 +1,9 @@
 #include "ServerSocketImpl.hpp"
 #include "ClientSocketImpl.hpp"
+#include "RioClientSocketImpl.hpp"
 #include "Exports.hpp"
 #include "ScopeGuard.hpp"
+#include <algorithm>
 
 
 COMMUNICATION_TAG Communication::ServerSocket* CreateServerSocket()
@@ -22,6 +24,9 @@ COMMUNICATION_TAG void DeleteServerSocket(Communication::ServerSocket* sock)
 
 namespace Communication
 {
+	/** Accepts posted at once with Registered I/O, at most. */
+	constexpr int maxPendingAccepts = 16;
+
 	ServerSocketImpl::ServerSocketImpl()
 	{
 		ZeroMemory(&hints, sizeof(hints));
@@ -58,6 +63,7 @@ namespace Communication
 			_log_("Nu s-a putut crea socketul, error = ", error);
 			return error;
 		}
+		enableLoopbackFastPath(listener);		// The accepted sockets inherit it
 
 		if (int error = ::bind(listener, result->ai_addr, int(result->ai_addrlen)); error == SOCKET_ERROR)
 		{
@@ -76,23 +82,327 @@ namespace Communication
 			_log_("Nu s-a reusit listen cu backlog = ", clientCount, ", error = ", error);
 			return error;
 		}
+
+		// Clients are awaited with WSAPoll, so the wait can end at a deadline or be cancelled
+		u_long nonBlocking = 1;
+		if (ioctlsocket(listener, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut face socketul neblocant, error = ", error);
+			return error;
+		}
+		if (int error = createWakeSocket(wakeSocket); error)
+			return error;
+		return registeredIo ? startRegisteredIo(clientCount) : ERROR_SUCCESS;
+	}
+
+	int ServerSocketImpl::startRegisteredIo(int clientCount)
+	{
+		// Without Registered I/O the clients are accepted and served as usual
+		auto queue = std::make_shared<RioCompletionQueue>();
+		if (queue->open(listener) != ERROR_SUCCESS)
+		{
+			_log_("Clientii vor folosi socket-uri obisnuite.");
+			return ERROR_SUCCESS;
+		}
+
+		GUID acceptExId = WSAID_ACCEPTEX;
+		DWORD returned = 0;
+		if (WSAIoctl(listener, SIO_GET_EXTENSION_FUNCTION_POINTER, &acceptExId, sizeof(acceptExId),
+			&acceptEx, sizeof(acceptEx), &returned, nullptr, nullptr) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut obtine AcceptEx, error = ", error);
+			return error;
+		}
+
+		// The waits are on the events of the accepts, the wake socket is watched through one too
+		wakeEvent = WSACreateEvent();
+		if (wakeEvent == WSA_INVALID_EVENT || WSAEventSelect(wakeSocket, wakeEvent, FD_READ) == SOCKET_ERROR)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut asocia un eveniment socketului de trezire, error = ", error);
+			return error;
+		}
+
+		pendingAccepts.resize(size_t(std::clamp(clientCount, 1, maxPendingAccepts)));
+		for (PendingAccept& pending : pendingAccepts)
+		{
+			pending.overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+			if (pending.overlapped.hEvent == nullptr)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut crea evenimentul unei acceptari, error = ", error);
+				return error;
+			}
+			if (int error = postAccept(pending); error)
+				return error;
+		}
+		completionQueue = std::move(queue);
+		return ERROR_SUCCESS;
+	}
+
+	int ServerSocketImpl::postAccept(PendingAccept& pending)
+	{
+		// Registered I/O needs sockets created for it
+		pending.socket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+		if (pending.socket == INVALID_SOCKET)
+		{
+			int error = WSAGetLastError();
+			_log_("Nu s-a putut crea socketul unei acceptari, error = ", error);
+			return error;
+		}
+
+		ResetEvent(pending.overlapped.hEvent);
+		DWORD received = 0;
+		if (!acceptEx(listener, pending.socket, pending.addresses, 0, sizeof(sockaddr_in) + 16, sizeof(sockaddr_in) + 16, &received, &pending.overlapped))
+		{
+			int error = WSAGetLastError();
+			if (error != ERROR_IO_PENDING)
+			{
+				_log_("Nu s-a putut posta o acceptare, error = ", error);
+				::closesocket(pending.socket);
+				pending.socket = INVALID_SOCKET;
+				return error;
+			}
+		}
 		return ERROR_SUCCESS;
 	}
+
+	int ServerSocketImpl::acceptRegistered(SOCKET& accepted, const Deadline& deadline)
+	{
+		std::vector<HANDLE> events;
+		for (const PendingAccept& pending : pendingAccepts)
+			events.push_back(pending.overlapped.hEvent);
+		events.push_back(wakeEvent);
+
+		for (;;)
+		{
+			if (cancelled)
+				return ERROR_CANCELLED;
+			const int timeout = deadline.getRemainingMilliseconds();
+			const DWORD result = WaitForMultipleObjects(DWORD(events.size()), events.data(), FALSE, timeout < 0 ? INFINITE : DWORD(timeout));
+			if (result == WAIT_FAILED)
+			{
+				int error = GetLastError();
+				_log_("Asteptarea clientilor a esuat, error = ", error);
+				return error;
+			}
+			if (cancelled)
+				return ERROR_CANCELLED;
+			if (result == WAIT_TIMEOUT)
+			{
+				_log_("Niciun client nu s-a conectat in timpul alocat.");
+				return WSAETIMEDOUT;
+			}
+
+			const size_t index = result - WAIT_OBJECT_0;
+			if (index == pendingAccepts.size())
+			{
+				WSAResetEvent(wakeEvent);
+				char drained[16];
+				while (recv(wakeSocket, drained, sizeof(drained), 0) > 0)
+					;
+				continue;
+			}
+
+			// The socket of a completed accept becomes the client, another accept takes its place
+			PendingAccept& pending = pendingAccepts[index];
+			DWORD transferred = 0, flags = 0;
+			int error = ERROR_SUCCESS;
+			if (!WSAGetOverlappedResult(listener, &pending.overlapped, &transferred, FALSE, &flags)
+				|| setsockopt(pending.socket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, reinterpret_cast<char *>(&listener), sizeof(listener)) == SOCKET_ERROR)
+				error = WSAGetLastError();
+			accepted = pending.socket;
+			pending.socket = INVALID_SOCKET;
+			if (error != ERROR_SUCCESS)
+			{
+				_log_("Nu s-a reusit acceptarea, error = ", error);
+				::closesocket(accepted);
+				accepted = INVALID_SOCKET;
+			}
+			if (int postError = postAccept(pending); postError)
+			{
+				if (accepted != INVALID_SOCKET)
+					::closesocket(accepted);
+				accepted = INVALID_SOCKET;
+				return postError;
+			}
+			return error;
+		}
+	}
 	
+	int ServerSocketImpl::getPort() const
+	{
+		sockaddr_in address = {};
+		int length = sizeof(address);
+		if (listener == INVALID_SOCKET || getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) == SOCKET_ERROR)
+			return 0;
+		return ntohs(address.sin_port);
+	}
+
 	ClientSocket* ServerSocketImpl::acceptClient()
 	{
-		SOCKET client = accept(listener, NULL, NULL);
-		if (client == INVALID_SOCKET)
+		ClientSocket* client = nullptr;
+		acceptClient(client, Deadline());
+		return client;
+	}
+
+	int ServerSocketImpl::acceptClient(ClientSocket*& client, const Deadline& deadline)
+	{
+		client = nullptr;
+		SOCKET accepted = INVALID_SOCKET;
+		if (completionQueue != nullptr)
+			if (int error = acceptRegistered(accepted, deadline); error)
+				return error;
+		while (accepted == INVALID_SOCKET)
+		{
+			if (cancelled)
+				return ERROR_CANCELLED;
+			WSAPOLLFD descriptors[] = { { listener, POLLRDNORM, 0 }, { wakeSocket, POLLRDNORM, 0 } };
+			const int ready = WSAPoll(descriptors, wakeSocket != INVALID_SOCKET ? 2 : 1, deadline.getRemainingMilliseconds());
+			if (ready == SOCKET_ERROR)
+			{
+				int error = WSAGetLastError();
+				_log_("Apelul WSAPoll a intors eroarea ", error);
+				return error;
+			}
+			if (cancelled)
+				return ERROR_CANCELLED;
+			if (ready == 0)
+			{
+				_log_("Niciun client nu s-a conectat in timpul alocat.");
+				return WSAETIMEDOUT;
+			}
+
+			accepted = accept(listener, NULL, NULL);
+			if (accepted == INVALID_SOCKET)
+			{
+				int error = WSAGetLastError();
+				if (error == WSAEWOULDBLOCK)
+					continue;
+				_log_("Nu s-a reusit acceptarea, error = ", error);
+				return error;
+			}
+		}
+
+		ClientSocketImpl* clientSocket = nullptr;
+		if (completionQueue != nullptr)
 		{
-			_log_("Nu s-a reusit acceptarea, error = ", WSAGetLastError());
-			return nullptr;
+			RioClientSocketImpl* rioSocket = new RioClientSocketImpl(accepted, completionQueue);
+			clientSocket = rioSocket;
+			if (int error = rioSocket->open(); error)
+			{
+				delete clientSocket;
+				return error;
+			}
 		}
-		return new ClientSocketImpl(client);
+		else
+			clientSocket = new ClientSocketImpl(accepted);
+		if (requestedFeatures & Protocol::Feature::Crc32c)
+			clientSocket->enableIntegrityCheck();
+		if (requestedFeatures & Protocol::Feature::FlowControl)
+			clientSocket->enableFlowControl(receiveWindow, sendQueueLimit);
+		if (requestedFeatures & Protocol::Feature::Channels)
+			clientSocket->enableChannels(sliceSize);
+		if (concurrentSends)
+			clientSocket->enableConcurrentSends();
+		clientSocket->setMaxFrameSize(maxFrameSize);
+		if (!capturePath.empty())
+			if (int error = clientSocket->enableCapture(capturePath + "." + std::to_string(capturedClients++)); error)
+			{
+				delete clientSocket;
+				return error;
+			}
+		if (int error = clientSocket->handshake(deadline); error)
+		{
+			_log_("Handshake-ul cu clientul acceptat a esuat, error = ", error);
+			delete clientSocket;
+			return error;
+		}
+		client = clientSocket;
+		return ERROR_SUCCESS;
 	}
 
 	int ServerSocketImpl::close()
 	{
+		// A posted accept writes to its entry until it is cancelled
+		for (PendingAccept& pending : pendingAccepts)
+		{
+			if (pending.socket != INVALID_SOCKET)
+			{
+				DWORD transferred = 0, flags = 0;
+				CancelIoEx(reinterpret_cast<HANDLE>(listener), &pending.overlapped);
+				WSAGetOverlappedResult(listener, &pending.overlapped, &transferred, TRUE, &flags);
+				::closesocket(pending.socket);
+			}
+			if (pending.overlapped.hEvent != nullptr)
+				CloseHandle(pending.overlapped.hEvent);
+		}
+		pendingAccepts.clear();
+		if (wakeEvent != nullptr)
+			WSACloseEvent(wakeEvent);
+		wakeEvent = nullptr;
+		completionQueue.reset();		// The clients keep it while they need it
+		acceptEx = nullptr;
+
+		if (wakeSocket != INVALID_SOCKET)
+			::closesocket(wakeSocket);
+		wakeSocket = INVALID_SOCKET;
+		cancelled = false;
+		const int error = _close(listener);
 		listener = INVALID_SOCKET;
-		return _close(listener);
+		return error;
+	}
+
+	void ServerSocketImpl::cancel()
+	{
+		cancelled = true;
+		wake(wakeSocket);
+	}
+
+	void ServerSocketImpl::enableIntegrityCheck()
+	{
+		requestedFeatures |= Protocol::Feature::Crc32c;
+	}
+
+	void ServerSocketImpl::enableFlowControl(size_t receiveWindow, size_t sendQueueLimit)
+	{
+		requestedFeatures |= Protocol::Feature::FlowControl;
+		this->receiveWindow = receiveWindow;
+		this->sendQueueLimit = sendQueueLimit;
+	}
+
+	void ServerSocketImpl::enableChannels(size_t sliceSize)
+	{
+		requestedFeatures |= Protocol::Feature::Channels | Protocol::Feature::FlowControl;
+		this->sliceSize = sliceSize;
+	}
+
+	void ServerSocketImpl::enableConcurrentSends()
+	{
+		requestedFeatures |= Protocol::Feature::FlowControl;
+		concurrentSends = true;
+	}
+
+	void ServerSocketImpl::setMaxFrameSize(size_t maxFrameSize)
+	{
+		this->maxFrameSize = maxFrameSize;
+	}
+
+	void ServerSocketImpl::enableRegisteredIo()
+	{
+		registeredIo = true;
+	}
+
+	int ServerSocketImpl::enableCapture(const std::string& path)
+	{
+		// Created now, so a bad path fails here and not at the first accept; the first client replaces it
+		TrafficCapture probe;
+		if (int error = probe.open(path + ".0"); error)
+			return error;
+		capturePath = path;
+		capturedClients = 0;
+		return ERROR_SUCCESS;
 	}
 }
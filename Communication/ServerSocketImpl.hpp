@@ -2,6 +2,11 @@
 
 #include "Socket.hpp"
 #include "ServerSocket.hpp"
+#include "Protocol.hpp"
+#include "RioCompletionQueue.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace Communication
 {
@@ -11,6 +16,31 @@ namespace Communication
 	{
 		SOCKET listener = INVALID_SOCKET;
 		addrinfo hints, *result = nullptr;
+		unsigned char requestedFeatures = Protocol::Feature::None;		// For the accepted clients
+		size_t receiveWindow = Protocol::defaultReceiveWindow;
+		size_t sendQueueLimit = Protocol::defaultSendQueueLimit;
+		size_t sliceSize = Protocol::defaultSliceSize;
+		bool concurrentSends = false;
+		size_t maxFrameSize = Protocol::defaultMaxFrameSize;
+		std::string capturePath;				// Empty if the clients are not captured
+		size_t capturedClients = 0;
+		std::atomic<bool> cancelled{ false };
+		SOCKET wakeSocket = INVALID_SOCKET;
+
+		/** An accept posted ahead with AcceptEx, see enableRegisteredIo. */
+		struct PendingAccept
+		{
+			SOCKET socket = INVALID_SOCKET;		// Becomes the client
+			OVERLAPPED overlapped = {};
+			char addresses[2 * (sizeof(sockaddr_in) + 16)];
+		};
+
+		// Registered I/O, completionQueue is null if it is not used
+		bool registeredIo = false;
+		std::shared_ptr<RioCompletionQueue> completionQueue;
+		LPFN_ACCEPTEX acceptEx = nullptr;
+		std::vector<PendingAccept> pendingAccepts;		// Not resized while posted
+		HANDLE wakeEvent = nullptr;						// Set by the wake socket
 
 	public:
 		ServerSocketImpl();
@@ -18,7 +48,25 @@ namespace Communication
 
 		virtual int bind(int port) override;
 		virtual int listen(int clientCount) override;
+		virtual int getPort() const override;
 		virtual ClientSocket* acceptClient() override;
+		virtual int acceptClient(ClientSocket*& client, const Deadline& deadline) override;
 		virtual int close() override;
+		virtual void cancel() override;
+
+		virtual void enableIntegrityCheck() override;
+		virtual void enableFlowControl(size_t receiveWindow, size_t sendQueueLimit) override;
+		virtual void enableChannels(size_t sliceSize) override;
+		virtual void enableConcurrentSends() override;
+		virtual void setMaxFrameSize(size_t maxFrameSize) override;
+		virtual void enableRegisteredIo() override;
+		virtual int enableCapture(const std::string& path) override;
+
+	private:
+		/** Creates the completion queue and posts the accepts, leaves completionQueue null where Registered I/O is missing. */
+		int startRegisteredIo(int clientCount);
+		int postAccept(PendingAccept& pending);
+		/** Waits for one of the posted accepts and posts it again. */
+		int acceptRegistered(SOCKET& accepted, const Deadline& deadline);
 	};
 }
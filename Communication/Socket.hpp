@@ -2,6 +2,7 @@
 
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <mstcpip.h>
 #include <Buffer.hpp>
 
 namespace Communication
@@ -14,11 +15,16 @@ namespace Communication
 			if (socket == INVALID_SOCKET)
 				return ERROR_SUCCESS;
 
-			if (int error = ::shutdown(socket, SD_BOTH); error == SOCKET_ERROR)
+			// The socket is closed even if shutdown fails; a listening socket, or one never connected, is not connected
+			int result = ERROR_SUCCESS;
+			if (::shutdown(socket, SD_BOTH) == SOCKET_ERROR)
 			{
-				error = WSAGetLastError();
-				_log_("Socketul nu poate apela shutdown, error = ", error);
-				return error;
+				const int error = WSAGetLastError();
+				if (error != WSAENOTCONN)
+				{
+					_log_("Socketul nu poate apela shutdown, error = ", error);
+					result = error;
+				}
 			}
 			if (int error = ::closesocket(socket); error == SOCKET_ERROR)
 			{
@@ -27,7 +33,56 @@ namespace Communication
 				return error;
 			}
 
+			return result;
+		}
+
+		/** A UDP socket connected to itself: a byte sent to it wakes a WSAPoll that includes it. Used by cancel and by concurrent senders. */
+		static int createWakeSocket(SOCKET& wakeSocket)
+		{
+			wakeSocket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			if (wakeSocket == INVALID_SOCKET)
+			{
+				int error = WSAGetLastError();
+				_log_("Nu s-a putut crea socketul de trezire, error = ", error);
+				return error;
+			}
+
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			int length = sizeof(address);
+			if (::bind(wakeSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == SOCKET_ERROR
+				|| ::getsockname(wakeSocket, reinterpret_cast<sockaddr *>(&address), &length) == SOCKET_ERROR
+				|| ::connect(wakeSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == SOCKET_ERROR)
+			{
+				int error = WSAGetLastError();
+				_log_("Nu s-a putut conecta socketul de trezire, error = ", error);
+				::closesocket(wakeSocket);
+				wakeSocket = INVALID_SOCKET;
+				return error;
+			}
+
+			// Read until empty after a wake, several senders may have written to it
+			u_long nonBlocking = 1;
+			ioctlsocket(wakeSocket, FIONBIO, &nonBlocking);
 			return ERROR_SUCCESS;
 		}
+
+		/**
+		 * Loopback connections skip most of the TCP stack when both ends set this before they connect.
+		 * Other connections, and Windows versions without it, ignore it.
+		 */
+		static void enableLoopbackFastPath(SOCKET socket)
+		{
+			int enabled = 1;
+			DWORD returned = 0;
+			WSAIoctl(socket, SIO_LOOPBACK_FAST_PATH, &enabled, sizeof(enabled), nullptr, 0, &returned, nullptr, nullptr);
+		}
+
+		static void wake(SOCKET wakeSocket)
+		{
+			if (wakeSocket != INVALID_SOCKET)
+				::send(wakeSocket, "", 1, 0);
+		}
 	};
 }
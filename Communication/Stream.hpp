@@ -0,0 +1,133 @@
+#pragma once
+
+#include <winsock2.h>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include "ClientSocket.hpp"
+#include "Serializers.hpp"
+
+namespace Communication
+{
+	/** Elements per chunk of a stream, when not given. */
+	constexpr size_t defaultStreamChunkSize = 64 * 1024;
+
+	/**
+	 * Sends the values as a stream: a Stream buffer with the 64-bit element count, followed by Vector
+	 * (or Array) buffers of at most chunkSize elements. Only one chunk is serialized at a time, so the memory used
+	 * does not depend on the size of the vector.
+	 */
+	template<typename Type> int sendStream(ClientSocket& socket, const std::vector<Type>& values, size_t chunkSize = defaultStreamChunkSize)
+	{
+		assert(chunkSize > 0, "Un stream nu poate avea chunk-uri goale.");
+
+		const uint64_t elementCount = values.size();
+		void* bytes = std::malloc(Buffer::getHeaderSize(sizeof(elementCount)) + sizeof(elementCount));
+		if (bytes == nullptr)
+		{
+			_log_("Nu s-a putut aloca header-ul stream-ului.");
+			return ERROR_OUTOFMEMORY;
+		}
+		const size_t headerSize = Buffer::writeHeader(bytes, Buffer::BufferType::Stream, sizeof(elementCount));
+		Endian::toWire(&elementCount, 1, static_cast<char *>(bytes) + headerSize);
+		if (int error = socket.sendBuffer(Buffer(std::move(bytes))); error)
+			return error;
+
+		for (size_t first = 0; first < values.size(); first += chunkSize)
+		{
+			const size_t count = std::min(chunkSize, values.size() - first);
+			if (int error = socket.sendBuffer(BasicSerializer<std::vector<Type>>::serializeRange(values.data() + first, count)); error)
+				return error;
+		}
+		return ERROR_SUCCESS;
+	}
+
+	/**
+	 * Yields the elements of a stream sent with sendStream, a chunk is received only after the previous
+	 * one was consumed. The elements can be processed while the rest of the stream is still in transit.
+	 */
+	template<typename Type> class StreamReader
+	{
+		ClientSocket& socket;
+		uint64_t elementCount = 0;
+		uint64_t remaining = 0;			// Elements not received yet
+		std::vector<Type> chunk;
+		Buffer received;				// The memory of the last chunk, reused for the next one
+		size_t position = 0;			// Next element of the chunk
+		int error = ERROR_SUCCESS;
+
+	public:
+		explicit StreamReader(ClientSocket& socket)
+			: socket(socket) {}
+
+		/** Receives the start of the stream, must be called before reading the elements. */
+		int open()
+		{
+			Buffer header;
+			if (error = socket.receiveBuffer(header); error)
+				return error;
+			if (header.getType() != Buffer::BufferType::Stream || header.getDataSize() != sizeof(elementCount))
+			{
+				_log_("Bufferul primit nu este inceputul unui stream.");
+				return error = ERROR_INVALID_DATA;
+			}
+
+			Endian::fromWire(header.getData(), 1, &elementCount);
+			remaining = elementCount;
+			chunk.clear();
+			position = 0;
+			return ERROR_SUCCESS;
+		}
+
+		/** Returns false at the end of the stream or on error, see getError. */
+		bool next(Type& value)
+		{
+			if (position == chunk.size() && !receiveChunk())
+				return false;
+			value = std::move(chunk[position++]);
+			return true;
+		}
+
+		/** Moves the rest of the current chunk (receiving the next one if needed) into values, for bulk processing. */
+		bool nextChunk(std::vector<Type>& values)
+		{
+			if (position == chunk.size() && !receiveChunk())
+				return false;
+			values.assign(std::make_move_iterator(chunk.begin() + position), std::make_move_iterator(chunk.end()));
+			position = chunk.size();
+			return true;
+		}
+
+		uint64_t getElementCount() const { return elementCount; }
+		int getError() const { return error; }
+
+	private:
+		bool receiveChunk()
+		{
+			if (remaining == 0 || error != ERROR_SUCCESS)
+				return false;
+
+			if (error = socket.receiveBuffer(received); error)
+				return false;
+			if (received.getType() != Buffer::BufferType::Vector && received.getType() != Buffer::BufferType::Array
+				&& received.getType() != Buffer::BufferType::Columns)
+			{
+				_log_("Stream-ul contine un buffer care nu este vector.");
+				error = ERROR_INVALID_DATA;
+				return false;
+			}
+
+			BasicSerializer<std::vector<Type>>::deserializeInto(received, chunk);
+			position = 0;
+			if (chunk.empty() || chunk.size() > remaining)
+			{
+				_log_("Stream-ul contine un chunk de ", chunk.size(), " elemente, mai erau de primit ", remaining, ".");
+				error = ERROR_INVALID_DATA;
+				return false;
+			}
+			remaining -= chunk.size();
+			return true;
+		}
+	};
+}
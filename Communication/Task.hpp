@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include "Serializers.hpp"
+
+namespace Communication
+{
+	/** Port on which the Master waits for the Slaves, when not given on the command line. */
+	constexpr int defaultMasterPort = 27015;
+
+	/** Kinds of messages sent by the Master to a Slave. */
+	enum class TaskKind
+	{
+		Map,			// Apply a map function on every element of the input, optionally followed by a combiner
+		Reduce,			// Fold the input with a reduce function, the result is a single value
+		For,			// Call a function for every index in [begin, end)
+		Shutdown,		// The Slave must close the connection and exit
+		Release,		// The Slave drops the outputs of task graph nodes it kept, no reply
+		Fetch			// Sent by a Slave to another: the output of a task graph node kept there
+	};
+
+	/** Names of the fields of the task and result messages (both are SerializedData). */
+	namespace TaskField
+	{
+		constexpr const char* kind = "kind";
+		constexpr const char* taskId = "taskId";
+		constexpr const char* function = "function";
+		constexpr const char* combiner = "combiner";
+		constexpr const char* input = "input";
+		constexpr const char* datasetId = "datasetId";
+		constexpr const char* begin = "begin";
+		constexpr const char* end = "end";
+		constexpr const char* status = "status";
+		constexpr const char* result = "result";
+		constexpr const char* resident = "resident";
+		constexpr const char* evicted = "evicted";
+
+		// Task graphs, see Master::TaskGraph
+		constexpr const char* inputs = "inputs";			// Outputs of other nodes taken as input
+		constexpr const char* sources = "sources";			// "host:port" of the Slave holding each input, empty if it is the same Slave
+		constexpr const char* output = "output";			// The Slave keeps the result under this id
+		constexpr const char* fetch = "fetch";				// The result is also sent to the Master
+		constexpr const char* outputSize = "outputSize";
+		constexpr const char* released = "released";
+		constexpr const char* peerPort = "peerPort";		// Where a Slave serves the other Slaves, sent after it connects
+	}
+}
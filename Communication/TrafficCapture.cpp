@@ -0,0 +1,114 @@
+#include "TrafficCapture.hpp"
+
+
+namespace Communication
+{
+	TrafficCapture::~TrafficCapture()
+	{
+		close();
+	}
+
+	int TrafficCapture::open(const std::string& path)
+	{
+		close();
+		file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut crea captura \"", path, "\", error = ", error);
+			return error;
+		}
+
+		start = std::chrono::steady_clock::now();
+		stopping = false;
+		error = ERROR_SUCCESS;
+		pending.assign(fileMagic, fileMagic + sizeof(fileMagic));
+		writer = std::thread(&TrafficCapture::write, this);
+		return ERROR_SUCCESS;
+	}
+
+	void TrafficCapture::record(Direction direction, unsigned char channel, const Buffer& frame)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		wakeRecorders.wait(lock, [this] { return (!recording && pending.size() < maxPendingBytes) || stopping; });
+		if (stopping || error != ERROR_SUCCESS)
+			return;
+
+		// Timed under the lock, so the times grow in the order of the records
+		const uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		char header[recordHeaderSize];
+		Endian::toWire(&time, 1, header);
+		header[8] = static_cast<char>(direction);
+		header[9] = static_cast<char>(channel);
+		const char* bytes = static_cast<const char *>(static_cast<const void *>(frame));
+		pending.insert(pending.end(), header, header + recordHeaderSize);
+
+		// A frame larger than the room left goes in pieces, each once the writer took the previous one;
+		// the other recorders wait meanwhile, so the record stays contiguous in the file
+		recording = true;
+		for (size_t copied = 0; ; )
+		{
+			const size_t piece = std::min(frame.getSize() - copied, maxPendingBytes - std::min(pending.size(), maxPendingBytes));
+			pending.insert(pending.end(), bytes + copied, bytes + copied + piece);
+			copied += piece;
+			wakeWriter.notify_one();
+			if (copied == frame.getSize())
+				break;
+			wakeRecorders.wait(lock, [this] { return pending.size() < maxPendingBytes || stopping; });
+			if (stopping || error != ERROR_SUCCESS)
+				break;		// The record stays cut, CaptureReader stops before it
+		}
+		recording = false;
+		wakeRecorders.notify_all();
+	}
+
+	void TrafficCapture::close()
+	{
+		if (!writer.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			stopping = true;
+		}
+		wakeWriter.notify_one();
+		wakeRecorders.notify_all();
+		writer.join();
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		pending.clear();
+	}
+
+	void TrafficCapture::write()
+	{
+		std::vector<char> writing;
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			wakeWriter.wait(lock, [this] { return !pending.empty() || stopping; });
+			if (pending.empty())
+				return;
+
+			// The records keep coming into the other buffer while these are written
+			writing.clear();
+			std::swap(writing, pending);
+			wakeRecorders.notify_all();
+			lock.unlock();
+			int failed = ERROR_SUCCESS;
+			for (size_t written = 0; written < writing.size(); )
+			{
+				DWORD count = 0;
+				const DWORD size = DWORD(std::min<size_t>(writing.size() - written, MAXDWORD));
+				if (!WriteFile(file, writing.data() + written, size, &count, nullptr))
+				{
+					failed = GetLastError();
+					_log_("Nu s-a putut scrie in captura, error = ", failed, "; urmatoarele frame-uri nu mai sunt inregistrate.");
+					break;
+				}
+				written += count;
+			}
+			lock.lock();
+			if (failed != ERROR_SUCCESS)
+				error = failed;
+		}
+	}
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "Buffer.hpp"
+
+namespace Communication
+{
+	/**
+	 * Frames sent and received by a connection, appended to a file, see ClientSocket::enableCapture. The file starts
+	 * with fileMagic, every record is the time in microseconds since the capture started (64 bits, little-endian),
+	 * the direction, the channel and then the serialized frame, whose header gives its size.
+	 * The frames are copied and written by a thread of the capture, so the connection does not wait for the disk.
+	 */
+	class TrafficCapture
+	{
+	public:
+		enum class Direction : unsigned char
+		{
+			Sent,
+			Received
+		};
+
+		static constexpr char fileMagic[8] = { 'P', 'P', 'C', 'A', 'P', 'T', '0', '1' };
+		static constexpr size_t recordHeaderSize = 8 + 1 + 1;
+
+	private:
+		/** Bytes copied and not yet written, over it record waits for the writer. */
+		static constexpr size_t maxPendingBytes = 64 * 1024 * 1024;
+
+		HANDLE file = INVALID_HANDLE_VALUE;
+		std::chrono::steady_clock::time_point start;
+		std::vector<char> pending;			// Filled by record, swapped with the writer's buffer
+		std::thread writer;
+		std::mutex mutex;
+		std::condition_variable wakeWriter, wakeRecorders;
+		bool stopping = false;
+		bool recording = false;				// A frame is being copied in pieces, the other records wait for it
+		int error = ERROR_SUCCESS;			// Of a failed write, the records that follow are dropped
+
+	public:
+		TrafficCapture() = default;
+		~TrafficCapture();
+		TrafficCapture(const TrafficCapture&) = delete;
+		void operator =(const TrafficCapture&) = delete;
+
+		/** Creates the file, replacing an older one, and starts the writer. */
+		int open(const std::string& path);
+		/** Thread-safe; blocks only while the writer is maxPendingBytes behind, a larger frame is copied in pieces as it catches up. */
+		void record(Direction direction, unsigned char channel, const Buffer& frame);
+		/** Writes the records left and closes the file. */
+		void close();
+
+	private:
+		void write();
+	};
+
+	/** A capture mapped in memory, its frames are read in place. */
+	class CaptureReader
+	{
+	public:
+		struct Record
+		{
+			uint64_t time = 0;					// Microseconds since the capture started
+			TrafficCapture::Direction direction = TrafficCapture::Direction::Sent;
+			unsigned char channel = 0;
+			Buffer frame;						// A view of the file, valid while the reader is open
+		};
+
+	private:
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+		const char* view = nullptr;
+		size_t size = 0;
+		size_t position = 0;
+
+	public:
+		CaptureReader() = default;
+		CaptureReader(const CaptureReader&) = delete;
+		void operator =(const CaptureReader&) = delete;
+		~CaptureReader()
+		{
+			close();
+		}
+
+		int open(const std::string& path)
+		{
+			close();
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut deschide captura \"", path, "\", error = ", error);
+				return error;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize))
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut afla dimensiunea capturii \"", path, "\", error = ", error);
+				close();
+				return error;
+			}
+			size = size_t(fileSize.QuadPart);
+			if (size < sizeof(TrafficCapture::fileMagic))
+			{
+				_log_("Fisierul \"", path, "\" nu este o captura.");
+				close();
+				return ERROR_BAD_FORMAT;
+			}
+
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			view = mapping != nullptr ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (view == nullptr)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut mapa in memorie captura \"", path, "\", error = ", error);
+				close();
+				return error;
+			}
+			if (std::memcmp(view, TrafficCapture::fileMagic, sizeof(TrafficCapture::fileMagic)) != 0)
+			{
+				_log_("Fisierul \"", path, "\" nu este o captura.");
+				close();
+				return ERROR_BAD_FORMAT;
+			}
+			rewind();
+			return ERROR_SUCCESS;
+		}
+
+		void close()
+		{
+			if (view != nullptr)
+				UnmapViewOfFile(view);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			view = nullptr;
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+			size = position = 0;
+		}
+
+		void rewind()
+		{
+			position = sizeof(TrafficCapture::fileMagic);
+		}
+
+		/** False at the end of the capture, or at a record cut short (e.g. the process died while writing it). */
+		bool next(Record& record)
+		{
+			if (view == nullptr || size - position < TrafficCapture::recordHeaderSize)
+				return false;
+			const char* bytes = view + position;
+			const char* frame = bytes + TrafficCapture::recordHeaderSize;
+			Buffer::BufferType type;
+			size_t dataSize = 0;
+			const size_t available = size - position - TrafficCapture::recordHeaderSize;
+			const size_t headerSize = Buffer::readHeader(frame, std::min(available, Buffer::maxHeaderSize), type, dataSize);
+			if (headerSize == 0 || dataSize > available - headerSize)
+				return false;
+
+			Endian::fromWire(bytes, 1, &record.time);
+			record.direction = TrafficCapture::Direction(bytes[8]);
+			record.channel = static_cast<unsigned char>(bytes[9]);
+			record.frame = Buffer::view(frame);
+			position += TrafficCapture::recordHeaderSize + headerSize + dataSize;
+			return true;
+		}
+	};
+}
@@ -4,6 +4,7 @@
 #include <map>
 #include <string>
 #include <type_traits>
+#include <cstdint>
 
 namespace Communication
 {
@@ -24,6 +25,7 @@ namespace Communication
 		if constexpr (std::is_same<T, bool>::value
 			|| std::is_same<T, int>::value
 			|| std::is_same<T, size_t>::value
+			|| std::is_same<T, uint64_t>::value		// The same type as size_t on 64-bit targets
 			|| std::is_same<T, float>::value
 			|| std::is_same<T, double>::value
 			|| std::is_same<T, char>::value
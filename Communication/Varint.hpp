@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Communication
+{
+	/** LEB128 variable-length integers: 7 bits per byte, the high bit is set on every byte except the last. */
+	namespace Varint
+	{
+		/** Bytes needed by the largest 64-bit value. */
+		constexpr size_t maxSize = 10;
+
+		inline size_t encodedSize(uint64_t value)
+		{
+			size_t size = 1;
+			for (; value >= 0x80; value >>= 7)
+				size++;
+			return size;
+		}
+
+		/** Returns the number of bytes written. */
+		inline size_t encode(uint64_t value, void* destination)
+		{
+			unsigned char* bytes = static_cast<unsigned char *>(destination);
+			size_t size = 0;
+			for (; value >= 0x80; value >>= 7)
+				bytes[size++] = static_cast<unsigned char>(value | 0x80);
+			bytes[size++] = static_cast<unsigned char>(value);
+			return size;
+		}
+
+		/** Returns the number of bytes read, 0 if the value is not complete in the available bytes or too long. */
+		inline size_t decode(const void* source, size_t available, uint64_t& value)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char *>(source);
+			value = 0;
+			for (size_t i = 0; i < available && i < maxSize; i++)
+			{
+				value |= uint64_t(bytes[i] & 0x7F) << (7 * i);
+				if ((bytes[i] & 0x80) == 0)
+					return i + 1;
+			}
+			return 0;
+		}
+
+		/** Maps signed values to unsigned ones so that small negative values stay short: 0, -1, 1, -2 -> 0, 1, 2, 3. */
+		inline uint64_t zigzagEncode(int64_t value)
+		{
+			return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+		}
+		inline int64_t zigzagDecode(uint64_t value)
+		{
+			return int64_t(value >> 1) ^ -int64_t(value & 1);
+		}
+	}
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <winsock2.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+namespace Communication
+{
+	/**
+	 * Threads that split the work on large containers between the cores, see BasicSerializer<std::vector<Type>>.
+	 * The caller of forEachRange works on the ranges too, so the ranges get done even when every thread is busy.
+	 * Called from a thread of the pool, the work is not split again: nested containers are done by that thread.
+	 */
+	class WorkerPool
+	{
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+		std::condition_variable wakeWorkers;
+		bool stopping = false;
+
+		/** The ranges of one forEachRange, kept alive by the jobs that start after all of them were taken. */
+		struct Ranges
+		{
+			size_t count;
+			std::atomic<size_t> next{ 0 };
+			size_t done = 0;
+			std::mutex mutex;
+			std::condition_variable allDone;
+		};
+
+		/** The cores the process may run on, fewer than the machine's under an affinity mask or a job object. */
+		static size_t coreCount()
+		{
+			// The mask is 0 when the threads of the process span several processor groups, the machine's count is used then
+			DWORD_PTR processMask = 0, systemMask = 0;
+			if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask != 0)
+			{
+				size_t count = 0;
+				for (; processMask != 0; processMask &= processMask - 1)
+					count++;
+				return count;
+			}
+			return std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		static bool& isWorker()
+		{
+			thread_local bool worker = false;
+			return worker;
+		}
+
+	public:
+		explicit WorkerPool(size_t threadCount)
+		{
+			for (size_t i = 0; i < threadCount; i++)
+				workers.emplace_back(&WorkerPool::work, this);
+		}
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				stopping = true;
+			}
+			wakeWorkers.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+		WorkerPool(const WorkerPool&) = delete;
+		void operator =(const WorkerPool&) = delete;
+
+		/** One thread per core, the caller being one of them. Never destroyed, joining threads while the process exits can hang. */
+		static WorkerPool& shared()
+		{
+			static WorkerPool* pool = new WorkerPool(coreCount() - 1);
+			return *pool;
+		}
+
+		/** The threads of the pool and the caller. */
+		size_t getThreadCount() const
+		{
+			return workers.size() + 1;
+		}
+
+		/** Ranges of at least minRangeSize of the count elements, at most one per thread; 1 inside the pool. */
+		size_t getRangeCount(size_t count, size_t minRangeSize) const
+		{
+			if (isWorker() || minRangeSize == 0)
+				return 1;
+			return std::max<size_t>(1, std::min(getThreadCount(), count / minRangeSize));
+		}
+
+		/** First element of a range, the ranges have the same size give or take one element. */
+		static size_t getRangeStart(size_t range, size_t rangeCount, size_t count)
+		{
+			return count / rangeCount * range + std::min(range, count % rangeCount);
+		}
+
+		/** Calls function(range, first, last) for each of the rangeCount ranges of [0, count), returns when all are done. */
+		template<typename Function> void forEachRange(size_t rangeCount, size_t count, Function&& function)
+		{
+			if (rangeCount <= 1)
+			{
+				function(size_t(0), size_t(0), count);
+				return;
+			}
+
+			std::shared_ptr<Ranges> ranges = std::make_shared<Ranges>();
+			ranges->count = rangeCount;
+			auto run = [ranges, &function, count]
+			{
+				for (size_t range; (range = ranges->next.fetch_add(1)) < ranges->count; )
+				{
+					function(range, getRangeStart(range, ranges->count, count), getRangeStart(range + 1, ranges->count, count));
+					std::lock_guard<std::mutex> guard(ranges->mutex);
+					if (++ranges->done == ranges->count)
+						ranges->allDone.notify_one();
+				}
+			};
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				for (size_t i = 1; i < rangeCount; i++)
+					jobs.push_back(run);
+			}
+			wakeWorkers.notify_all();
+
+			run();
+			std::unique_lock<std::mutex> lock(ranges->mutex);
+			ranges->allDone.wait(lock, [&ranges] { return ranges->done == ranges->count; });
+		}
+
+	private:
+		void work()
+		{
+			isWorker() = true;
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				wakeWorkers.wait(lock, [this] { return !jobs.empty() || stopping; });
+				if (jobs.empty())
+					return;
+				std::function<void()> job = std::move(jobs.front());
+				jobs.pop_front();
+				lock.unlock();
+				job();
+				lock.lock();
+			}
+		}
+	};
+}
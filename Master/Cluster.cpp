@@ -0,0 +1,573 @@
+#include "Cluster.hpp"
+#include <algorithm>
+
+using namespace Communication;
+
+
+namespace Master
+{
+	/** Task graph nodes sent to a Slave before it replies, so it has the next one when it finishes. */
+	constexpr size_t maxNodesInFlight = 2;
+
+	Cluster::~Cluster()
+	{
+		shutdown();
+	}
+
+	int Cluster::acceptSlaves(ServerSocket& server, size_t slaveCount, const Deadline& deadline)
+	{
+		while (slaves.size() < slaveCount)
+		{
+			ClientSocket* slave = nullptr;
+			if (int error = server.acceptClient(slave, deadline); error)
+			{
+				_log_("Nu s-a putut accepta Slave-ul cu numarul ", slaves.size(), ", error = ", error);
+				return error;
+			}
+
+			// The Slave tells where it serves the other Slaves, they reach it at the address it connected from
+			Buffer message;
+			int peerPort = 0;
+			if (int error = slave->receiveBuffer(message, Protocol::Channel::Any, deadline); error)
+			{
+				_log_("Slave-ul cu numarul ", slaves.size(), " nu s-a inregistrat, error = ", error);
+				DeleteClientSocket(slave);
+				return error;
+			}
+			SerializedData::view(message).peek(TaskField::peerPort, peerPort);
+			peerAddresses.push_back(slave->getPeerAddress() + ":" + std::to_string(peerPort));
+			slaves.push_back(slave);
+			residentDatasets.emplace_back();
+			_log_("S-a conectat Slave-ul cu numarul ", slaves.size() - 1, ".");
+		}
+		return ERROR_SUCCESS;
+	}
+
+	void Cluster::shutdown()
+	{
+		for (ClientSocket* slave : slaves)
+		{
+			SerializedData message;
+			message.add(TaskField::kind, int(TaskKind::Shutdown));
+			// A Slave that stopped reading does not hold back the others
+			slave->sendBuffer(message, Protocol::Channel::Urgent, Deadline::after(std::chrono::seconds(1)));
+			DeleteClientSocket(slave);
+		}
+		slaves.clear();
+		residentDatasets.clear();
+		peerAddresses.clear();
+	}
+
+	int Cluster::enableMemoization(size_t memoryCapacity, const std::string& spillPath, size_t spillCapacity)
+	{
+		resultCache.reset(new ResultCache(memoryCapacity));
+		if (spillPath.empty())
+			return ERROR_SUCCESS;
+		return resultCache->enableSpill(spillPath, spillCapacity);
+	}
+
+	int Cluster::parallelFor(size_t begin, size_t end, const std::string& functionId)
+	{
+		std::vector<SerializedData> tasks;
+		std::vector<uint64_t> inputHashes;
+		for (auto& range : partition(end > begin ? end - begin : 0))
+		{
+			const size_t bounds[] = { begin + range.first, begin + range.second };
+			tasks.emplace_back();
+			tasks.back().add(TaskField::begin, bounds[0]);
+			tasks.back().add(TaskField::end, bounds[1]);
+			inputHashes.push_back(hashBytes(bounds, sizeof(bounds)));
+		}
+
+		std::vector<Buffer> results;
+		return dispatch(TaskKind::For, functionId, "", std::move(tasks), inputHashes, results);
+	}
+
+	std::vector<std::pair<size_t, size_t>> Cluster::partition(size_t count) const
+	{
+		std::vector<std::pair<size_t, size_t>> ranges;
+		const size_t partCount = std::min(count, slaves.size());
+		for (size_t i = 0, start = 0; i < partCount; i++)
+		{
+			const size_t partSize = count / partCount + (i < count % partCount ? 1 : 0);
+			ranges.emplace_back(start, start + partSize);
+			start += partSize;
+		}
+		return ranges;
+	}
+
+	std::vector<size_t> Cluster::place(const std::vector<DatasetId>& ids) const
+	{
+		assert(ids.size() <= slaves.size(), "Mai multe partitii decat Slave-uri.");
+		constexpr size_t unplaced = size_t(-1);
+		std::vector<size_t> placement(ids.size(), unplaced);
+		std::vector<bool> busy(slaves.size(), false);
+
+		// Partitions already resident on a free Slave go there
+		for (size_t i = 0; i < ids.size(); i++)
+			for (size_t slave = 0; slave < slaves.size(); slave++)
+				if (!busy[slave] && residentDatasets[slave].count(ids[i]))
+				{
+					placement[i] = slave;
+					busy[slave] = true;
+					break;
+				}
+
+		// The others go to the remaining Slaves
+		size_t slave = 0;
+		for (size_t i = 0; i < ids.size(); i++)
+			if (placement[i] == unplaced)
+			{
+				while (busy[slave])
+					slave++;
+				placement[i] = slave;
+				busy[slave] = true;
+			}
+		return placement;
+	}
+
+	int Cluster::dispatchDataset(TaskKind kind, const std::string& functionId, const std::string& combinerId,
+		const std::vector<Buffer>& partitions, const std::vector<DatasetId>& ids, std::vector<Buffer>& results)
+	{
+		if (ids.size() > slaves.size())
+		{
+			_log_("Setul de date are ", ids.size(), " partitii, dar sunt conectate doar ", slaves.size(), " Slave-uri.");
+			return ERROR_INVALID_PARAMETER;
+		}
+
+		std::vector<size_t> placement = place(ids);
+		std::vector<SerializedData> tasks(ids.size());
+		std::vector<uint64_t> inputHashes(ids.begin(), ids.end());		// The id is the hash of the partition
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			tasks[i].add(TaskField::datasetId, ids[i]);
+			if (!residentDatasets[placement[i]].count(ids[i]))
+				tasks[i].addBuffer(TaskField::input, Buffer(partitions[i]));
+		}
+		return dispatch(kind, functionId, combinerId, std::move(tasks), inputHashes, results, placement);
+	}
+
+	int Cluster::dispatch(TaskKind kind, const std::string& functionId, const std::string& combinerId,
+		std::vector<SerializedData>&& tasks, const std::vector<uint64_t>& inputHashes,
+		std::vector<Buffer>& results, const std::vector<size_t>& placement)
+	{
+		if (slaves.empty())
+		{
+			_log_("Nu exista niciun Slave conectat.");
+			return ERROR_NOT_READY;
+		}
+		assert(tasks.size() <= slaves.size(), "Mai multe partitii decat Slave-uri.");
+
+		auto slaveOf = [&placement](size_t task) { return placement.empty() ? task : placement[task]; };
+		const Deadline deadline = taskTimeout.count() > 0 ? Deadline::after(taskTimeout) : Deadline();
+
+		// Repeated tasks are answered from the cache and not sent at all; a parallelFor is run for its side effects,
+		// its result is only the count of indices, so it is never answered from the cache
+		results.clear();
+		results.resize(tasks.size());
+		std::vector<DatasetId> keys(tasks.size());
+		std::vector<bool> cached(tasks.size(), false);
+		const bool memoized = resultCache && kind != TaskKind::For;
+		if (memoized)
+			for (size_t i = 0; i < tasks.size(); i++)
+			{
+				keys[i] = ResultCache::getKey(kind, functionId, combinerId, inputHashes[i]);
+				cached[i] = resultCache->find(keys[i], results[i]);
+			}
+
+		// After a failure the replies of the tasks already sent are still read, else the next operation would take
+		// them for its own; a connection that failed or timed out is out of sync, its Slave is disconnected at the end
+		int failure = ERROR_SUCCESS;
+		std::vector<bool> done(cached), lost(slaves.size(), false);
+		auto abandon = [&](size_t i, int error)
+		{
+			lost[slaveOf(i)] = true;
+			done[i] = true;
+			if (failure == ERROR_SUCCESS)
+				failure = error;
+		};
+
+		// All the partitions are sent before waiting for any result, so the Slaves work in parallel
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			if (done[i])
+				continue;
+			if (failure != ERROR_SUCCESS)
+			{
+				done[i] = true;
+				continue;
+			}
+			tasks[i].add(TaskField::kind, int(kind));
+			tasks[i].add(TaskField::taskId, i);
+			tasks[i].add(TaskField::function, functionId);
+			tasks[i].add(TaskField::combiner, combinerId);
+			if (int error = slaves[slaveOf(i)]->sendBuffer(tasks[i], Protocol::Channel::Normal, deadline); error)
+			{
+				_log_("Nu s-a putut trimite partitia ", i, ", error = ", error);
+				abandon(i, error);
+			}
+		}
+
+		auto acceptReply = [&](size_t i, const Buffer& message)
+		{
+			const size_t slave = slaveOf(i);
+			SerializedData reply = SerializedData::view(message);
+			size_t taskId = 0;
+			int status = ERROR_SUCCESS;
+			reply.peek(TaskField::taskId, taskId);
+			reply.peek(TaskField::status, status);
+			assert(taskId == i, "Slave-ul ", slave, " a raspuns pentru partitia ", taskId, ".");
+
+			// Keep track of what the Slave holds, so the next operations know where to send the partitions
+			std::vector<DatasetId> evicted;
+			reply.peek(TaskField::evicted, evicted);
+			for (DatasetId id : evicted)
+				residentDatasets[slave].erase(id);
+			DatasetId datasetId = 0;
+			bool resident = false;
+			if (tasks[i].peek(TaskField::datasetId, datasetId) && reply.peek(TaskField::resident, resident))
+			{
+				if (resident)
+					residentDatasets[slave].insert(datasetId);
+				else
+					residentDatasets[slave].erase(datasetId);
+			}
+
+			if (status != ERROR_SUCCESS)
+			{
+				_log_("Slave-ul ", slave, " nu a putut executa \"", functionId, "\", error = ", status);
+				return status;
+			}
+
+			reply.removeBuffer(TaskField::result, results[i]);
+			if (memoized)
+				resultCache->insert(keys[i], results[i]);
+			return ERROR_SUCCESS;
+		};
+
+		// With flow control the tasks for slow Slaves may still be queued: until they are all sent, the replies
+		// are polled, so waiting for one Slave does not hold back the tasks of the others
+		Buffer message;
+		while (std::find(done.begin(), done.end(), false) != done.end())
+		{
+			bool queued = false;
+			for (size_t i = 0; i < tasks.size(); i++)
+				if (!done[i])
+				{
+					if (int error = slaves[slaveOf(i)]->pump(); error)
+					{
+						_log_("Nu s-a putut trimite partitia ", i, ", error = ", error);
+						abandon(i, error);
+						continue;
+					}
+					queued |= slaves[slaveOf(i)]->getQueuedBytes() != 0;
+				}
+
+			bool received = false;
+			for (size_t i = 0; i < tasks.size(); i++)
+			{
+				if (done[i])
+					continue;
+				ClientSocket* slave = slaves[slaveOf(i)];
+				int error = queued ? slave->tryReceiveBuffer(message) : slave->receiveBuffer(message, Protocol::Channel::Any, deadline);
+				if (error == WSAEWOULDBLOCK && deadline.hasExpired())
+					error = WSAETIMEDOUT;
+				if (error == WSAEWOULDBLOCK)
+					continue;
+				if (error == WSAETIMEDOUT)
+				{
+					// The task has to be given to another Slave, this one may have died
+					_log_("Slave-ul ", slaveOf(i), " nu a trimis rezultatul partitiei ", i, " in timpul alocat.");
+					abandon(i, error);
+					continue;
+				}
+				if (error)
+				{
+					_log_("Nu s-a putut primi rezultatul partitiei ", i, ", error = ", error);
+					abandon(i, error);
+					continue;
+				}
+				if (int status = acceptReply(i, message); status && failure == ERROR_SUCCESS)
+					failure = status;
+				done[i] = true;
+				received = true;
+			}
+			if (!received)
+			{
+				std::vector<ClientSocket *> busy;
+				for (size_t i = 0; i < tasks.size(); i++)
+					if (!done[i])
+						busy.push_back(slaves[slaveOf(i)]);
+				waitForReplies(busy, deadline);
+			}
+		}
+		disconnect(lost);
+		return failure;
+	}
+
+	void Cluster::waitForReplies(const std::vector<ClientSocket *>& busy, const Deadline& deadline)
+	{
+		// An error shows up again in the receive that follows, a timeout in the deadline check
+		WaitForInput(busy.data(), busy.size(), deadline.getRemainingMilliseconds());
+	}
+
+	void Cluster::disconnect(const std::vector<bool>& lost)
+	{
+		for (size_t slave = slaves.size(); slave-- > 0; )
+			if (lost[slave])
+			{
+				_log_("Slave-ul ", slave, " este deconectat, conexiunea cu el nu mai poate fi folosita.");
+				DeleteClientSocket(slaves[slave]);
+				slaves.erase(slaves.begin() + slave);
+				residentDatasets.erase(residentDatasets.begin() + slave);
+				peerAddresses.erase(peerAddresses.begin() + slave);
+			}
+	}
+
+	int Cluster::run(const TaskGraph& graph, std::vector<Buffer>& outputs)
+	{
+		if (slaves.empty())
+		{
+			_log_("Nu exista niciun Slave conectat.");
+			return ERROR_NOT_READY;
+		}
+		if (graph.rejected)
+		{
+			_log_("Graful contine noduri respinse, nu poate fi executat.");
+			return ERROR_INVALID_PARAMETER;
+		}
+
+		const std::vector<TaskGraph::Node>& nodes = graph.nodes;
+		const Deadline deadline = taskTimeout.count() > 0 ? Deadline::after(taskTimeout) : Deadline();
+		const size_t runId = runCount++;
+		auto outputId = [runId](size_t node)
+		{
+			const size_t key[] = { runId, node };
+			return DatasetId(hashBytes(key, sizeof(key)));
+		};
+		auto consumesInputs = [&nodes](size_t node) { return nodes[node].kind != TaskKind::For; };
+
+		// A node waits for its dependencies; the output of a node is kept on its Slave until all its consumers are done
+		constexpr size_t unplaced = size_t(-1);
+		std::vector<size_t> waiting(nodes.size()), consumers(nodes.size(), 0);
+		std::vector<std::vector<size_t>> dependents(nodes.size());
+		std::vector<size_t> ready;
+		for (size_t node = 0; node < nodes.size(); node++)
+		{
+			waiting[node] = nodes[node].dependencies.size();
+			for (size_t dependency : nodes[node].dependencies)
+			{
+				dependents[dependency].push_back(node);
+				if (consumesInputs(node))
+					consumers[dependency]++;
+			}
+			if (waiting[node] == 0)
+				ready.push_back(node);
+		}
+		std::vector<size_t> holder(nodes.size(), unplaced), outputSizes(nodes.size(), 0);
+		std::vector<std::vector<size_t>> running(slaves.size());		// A Slave replies in the order it got the nodes
+
+		// After a failure nothing more is sent, but the replies of the nodes in flight are still read, else the next
+		// operation would take them for its own; a connection that failed or timed out is out of sync, its Slave is
+		// disconnected at the end, with the nodes it was running
+		int failure = ERROR_SUCCESS;
+		std::vector<bool> lost(slaves.size(), false);
+		auto abandon = [&](size_t slave, int error)
+		{
+			lost[slave] = true;
+			running[slave].clear();
+			if (failure == ERROR_SUCCESS)
+				failure = error;
+		};
+		ScopeGuard disconnectLost([&] { disconnect(lost); });
+
+		auto release = [&](size_t node)
+		{
+			if (lost[holder[node]])		// Dropped with the connection
+				return;
+			SerializedData message;
+			message.add(TaskField::kind, int(TaskKind::Release));
+			message.add(TaskField::released, std::vector<DatasetId>{ outputId(node) });
+			if (int error = slaves[holder[node]]->sendBuffer(message, Protocol::Channel::Normal, deadline); error)
+			{
+				_log_("Nu s-a putut elibera rezultatul nodului ", node, ", error = ", error);
+				abandon(holder[node], error);
+			}
+		};
+		// After a failure the outputs still kept are dropped too, before the lost Slaves are forgotten
+		ScopeGuard releaseKept([&]
+		{
+			for (size_t node = 0; node < nodes.size(); node++)
+				if (holder[node] != unplaced && consumers[node] > 0)
+					release(node);
+		});
+
+		// The free Slave holding most of the input bytes of the node, the least loaded one among equals
+		auto place = [&](size_t node)
+		{
+			size_t best = unplaced, bestLocal = 0;
+			for (size_t slave = 0; slave < slaves.size(); slave++)
+			{
+				if (lost[slave] || running[slave].size() >= maxNodesInFlight)
+					continue;
+				size_t local = 0;
+				if (consumesInputs(node))
+					for (size_t dependency : nodes[node].dependencies)
+						if (holder[dependency] == slave)
+							local += outputSizes[dependency];
+				if (best == unplaced || local > bestLocal || (local == bestLocal && running[slave].size() < running[best].size()))
+				{
+					best = slave;
+					bestLocal = local;
+				}
+			}
+			return best;
+		};
+
+		auto send = [&](size_t node, size_t slave)
+		{
+			const TaskGraph::Node& graphNode = nodes[node];
+			SerializedData task;
+			task.add(TaskField::kind, int(graphNode.kind));
+			task.add(TaskField::taskId, node);
+			task.add(TaskField::function, graphNode.functionId);
+			task.add(TaskField::combiner, graphNode.combinerId);
+			if (graphNode.kind == TaskKind::For)
+			{
+				task.add(TaskField::begin, graphNode.begin);
+				task.add(TaskField::end, graphNode.end);
+			}
+			else if (graphNode.dependencies.empty())
+				task.addBuffer(TaskField::input, Buffer(graphNode.input));
+			else
+			{
+				std::vector<DatasetId> inputs;
+				std::vector<std::string> sources;
+				for (size_t dependency : graphNode.dependencies)
+				{
+					inputs.push_back(outputId(dependency));
+					sources.push_back(holder[dependency] == slave ? "" : peerAddresses[holder[dependency]]);
+				}
+				task.add(TaskField::inputs, inputs);
+				task.add(TaskField::sources, sources);
+			}
+			if (consumers[node] > 0)
+				task.add(TaskField::output, outputId(node));
+			task.add(TaskField::fetch, graphNode.fetched);
+			running[slave].push_back(node);
+			return slaves[slave]->sendBuffer(task, Protocol::Channel::Normal, deadline);
+		};
+
+		auto acceptReply = [&](size_t slave, const Buffer& message)
+		{
+			const size_t node = running[slave].front();
+			running[slave].erase(running[slave].begin());
+			SerializedData reply = SerializedData::view(message);
+			size_t taskId = 0;
+			int status = ERROR_SUCCESS;
+			reply.peek(TaskField::taskId, taskId);
+			reply.peek(TaskField::status, status);
+			assert(taskId == node, "Slave-ul ", slave, " a raspuns pentru nodul ", taskId, " in locul nodului ", node, ".");
+			if (status != ERROR_SUCCESS)
+			{
+				_log_("Slave-ul ", slave, " nu a putut executa nodul ", node, " (\"", nodes[node].functionId, "\"), error = ", status);
+				return status;
+			}
+
+			if (nodes[node].fetched)
+				reply.removeBuffer(TaskField::result, outputs[node]);
+			if (consumers[node] > 0)
+			{
+				holder[node] = slave;
+				reply.peek(TaskField::outputSize, outputSizes[node]);
+			}
+
+			// The inputs no other node needs are dropped, the nodes that waited only for this one are ready
+			if (consumesInputs(node))
+				for (size_t dependency : nodes[node].dependencies)
+					if (--consumers[dependency] == 0)
+						release(dependency);
+			for (size_t dependent : dependents[node])
+				if (--waiting[dependent] == 0)
+					ready.push_back(dependent);
+			return ERROR_SUCCESS;
+		};
+
+		outputs.clear();
+		outputs.resize(nodes.size());
+		Buffer message;
+		auto inFlight = [&running] { return std::any_of(running.begin(), running.end(), [](const std::vector<size_t>& nodes) { return !nodes.empty(); }); };
+		for (size_t remaining = nodes.size(); remaining > 0; )
+		{
+			if (failure == ERROR_SUCCESS)
+			{
+				// Ready nodes go out in the order they became ready, as long as some Slave has room
+				size_t sent = 0;
+				for (; sent < ready.size() && failure == ERROR_SUCCESS; sent++)
+				{
+					const size_t slave = place(ready[sent]);
+					if (slave == unplaced)
+						break;
+					if (int error = send(ready[sent], slave); error)
+					{
+						_log_("Nu s-a putut trimite nodul ", ready[sent], ", error = ", error);
+						abandon(slave, error);
+					}
+				}
+				ready.erase(ready.begin(), ready.begin() + sent);
+				if (sent == 0 && !inFlight())		// Else the loop would wait for replies that never come
+				{
+					_log_("Niciun nod al grafului nu mai poate fi executat.");
+					return ERROR_INVALID_PARAMETER;
+				}
+			}
+			if (failure != ERROR_SUCCESS && !inFlight())
+				break;
+
+			bool received = false;
+			for (size_t slave = 0; slave < slaves.size(); slave++)
+			{
+				if (running[slave].empty())
+					continue;
+				if (int error = slaves[slave]->pump(); error)
+				{
+					_log_("Nu s-au putut trimite nodurile Slave-ului ", slave, ", error = ", error);
+					abandon(slave, error);
+					continue;
+				}
+				int error = slaves[slave]->tryReceiveBuffer(message);
+				if (error == WSAEWOULDBLOCK)
+					continue;
+				if (error)
+				{
+					_log_("Nu s-a putut primi rezultatul nodului ", running[slave].front(), ", error = ", error);
+					abandon(slave, error);
+					continue;
+				}
+				if (int status = acceptReply(slave, message); status && failure == ERROR_SUCCESS)
+					failure = status;
+				remaining--;
+				received = true;
+			}
+			if (!received)
+			{
+				if (deadline.hasExpired())
+				{
+					_log_("Graful nu a fost executat in timpul alocat.");
+					for (size_t slave = 0; slave < slaves.size(); slave++)
+						if (!running[slave].empty())
+							abandon(slave, WSAETIMEDOUT);
+				}
+				else
+				{
+					std::vector<ClientSocket *> busy;
+					for (size_t slave = 0; slave < slaves.size(); slave++)
+						if (!running[slave].empty())
+							busy.push_back(slaves[slave]);
+					waitForReplies(busy, deadline);
+				}
+			}
+		}
+		return failure;
+	}
+}
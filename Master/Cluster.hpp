@@ -0,0 +1,220 @@
+#pragma once
+
+#include <winsock2.h>
+#include <vector>
+#include <set>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <Communication.hpp>
+#include <DatasetCache.hpp>
+#include <FunctionRegistry.hpp>
+#include <Task.hpp>
+#include "ResultCache.hpp"
+#include "TaskGraph.hpp"
+
+namespace Master
+{
+	/**
+	 * Input partitioned once and reused by several operations.
+	 * The Slaves keep the partitions they received, so later operations only send the partition ids.
+	 */
+	template<typename Type> class Dataset
+	{
+		friend class Cluster;
+
+		std::vector<Communication::Buffer> partitions;
+		std::vector<Communication::DatasetId> ids;
+		size_t elementCount = 0;
+
+	public:
+		size_t getElementCount() const { return elementCount; }
+	};
+
+	/**
+	 * The Slaves connected to this Master.
+	 * The input of every operation is split in one contiguous partition per Slave, the partitions are
+	 * processed in parallel and the partial results are merged, in order, on the Master.
+	 */
+	class Cluster
+	{
+		std::vector<Communication::ClientSocket *> slaves;
+		std::vector<std::set<Communication::DatasetId>> residentDatasets;		// What each Slave holds in its DatasetCache
+		std::vector<std::string> peerAddresses;		// "host:port" where each Slave serves the others
+		size_t runCount = 0;						// Task graphs run, their outputs are kept under distinct ids
+		std::unique_ptr<ResultCache> resultCache;
+		std::chrono::milliseconds taskTimeout{ 0 };
+
+	public:
+		Cluster() = default;
+		~Cluster();
+		Cluster(const Cluster&) = delete;
+		void operator =(const Cluster&) = delete;
+
+		int acceptSlaves(Communication::ServerSocket& server, size_t slaveCount, const Communication::Deadline& deadline = Communication::Deadline());
+		size_t getSlaveCount() const { return slaves.size(); }
+		/** An operation whose results do not all arrive within the timeout fails with WSAETIMEDOUT, 0 waits indefinitely. */
+		void setTaskTimeout(std::chrono::milliseconds timeout) { taskTimeout = timeout; }
+		/** Asks every Slave to exit and closes the connections. */
+		void shutdown();
+
+		/**
+		 * Answers repeated tasks (same function, same serialized input) from a cache instead of dispatching them.
+		 * parallelFor is never memoized, its functions are called for their side effects.
+		 * If spillPath is given, results evicted from memory are kept in a memory-mapped file of spillCapacity bytes.
+		 */
+		int enableMemoization(size_t memoryCapacity, const std::string& spillPath = "", size_t spillCapacity = 0);
+		const ResultCache* getResultCache() const { return resultCache.get(); }
+
+		/** Splits the input in one partition per Slave, to be used by the operations below instead of a std::vector. */
+		template<typename Type> void createDataset(const std::vector<Type>& input, Dataset<Type>& dataset) const
+		{
+			dataset.partitions.clear();
+			dataset.ids.clear();
+			dataset.elementCount = input.size();
+			for (auto& range : partition(input.size()))
+			{
+				Communication::Hasher hasher;
+				dataset.partitions.push_back(Communication::BasicSerializer<std::vector<Type>>::serializeRange(input.data() + range.first, range.second - range.first, &hasher));
+				dataset.ids.push_back(Communication::DatasetId(hasher.digest()));
+			}
+		}
+
+		/** output[i] = function(input[i]) */
+		template<typename In, typename Out> int parallelMap(const std::vector<In>& input, const std::string& functionId, std::vector<Out>& output)
+		{
+			std::vector<Communication::Buffer> results;
+			std::vector<uint64_t> inputHashes;
+			if (int error = dispatch(Communication::TaskKind::Map, functionId, "", serializePartitions(input, inputHashes), inputHashes, results); error)
+				return error;
+			return concatenate(results, input.size(), output);
+		}
+		template<typename In, typename Out> int parallelMap(const Dataset<In>& input, const std::string& functionId, std::vector<Out>& output)
+		{
+			std::vector<Communication::Buffer> results;
+			if (int error = dispatchDataset(Communication::TaskKind::Map, functionId, "", input.partitions, input.ids, results); error)
+				return error;
+			return concatenate(results, input.elementCount, output);
+		}
+
+		/** Maps every element and combines the mapped values, first on each Slave and then on the Master. */
+		template<typename In, typename Out> int parallelMapReduce(const std::vector<In>& input, const std::string& mapId, const std::string& combinerId, Out& output)
+		{
+			std::vector<Communication::Buffer> results;
+			std::vector<uint64_t> inputHashes;
+			if (int error = dispatch(Communication::TaskKind::Map, mapId, combinerId, serializePartitions(input, inputHashes), inputHashes, results); error)
+				return error;
+			return merge(combinerId, results, output);
+		}
+		template<typename In, typename Out> int parallelMapReduce(const Dataset<In>& input, const std::string& mapId, const std::string& combinerId, Out& output)
+		{
+			std::vector<Communication::Buffer> results;
+			if (int error = dispatchDataset(Communication::TaskKind::Map, mapId, combinerId, input.partitions, input.ids, results); error)
+				return error;
+			return merge(combinerId, results, output);
+		}
+
+		/** Folds the input with an associative function, the Master only receives one value per Slave. */
+		template<typename Type> int parallelReduce(const std::vector<Type>& input, const std::string& functionId, Type& output)
+		{
+			std::vector<Communication::Buffer> results;
+			std::vector<uint64_t> inputHashes;
+			if (int error = dispatch(Communication::TaskKind::Reduce, functionId, "", serializePartitions(input, inputHashes), inputHashes, results); error)
+				return error;
+			return merge(functionId, results, output);
+		}
+		template<typename Type> int parallelReduce(const Dataset<Type>& input, const std::string& functionId, Type& output)
+		{
+			std::vector<Communication::Buffer> results;
+			if (int error = dispatchDataset(Communication::TaskKind::Reduce, functionId, "", input.partitions, input.ids, results); error)
+				return error;
+			return merge(functionId, results, output);
+		}
+
+		/** Calls the function for every index in [begin, end), on the Slaves. */
+		int parallelFor(size_t begin, size_t end, const std::string& functionId);
+
+		/**
+		 * Runs the nodes of the graph as soon as the nodes they depend on are done, each on the Slave that holds
+		 * most of its input; the inputs held by other Slaves go from Slave to Slave, not through the Master.
+		 * outputs[node] is the output of the fetched nodes, empty for the others.
+		 */
+		int run(const TaskGraph& graph, std::vector<Communication::Buffer>& outputs);
+
+	private:
+		/** Splits [0, count) into at most one non-empty range per Slave. */
+		std::vector<std::pair<size_t, size_t>> partition(size_t count) const;
+
+		/**
+		 * Sends tasks[i] to Slave placement[i] (Slave i if placement is empty), then waits for all the results.
+		 * inputHashes[i] is the hash of the input of tasks[i], used as key for the result cache.
+		 */
+		int dispatch(Communication::TaskKind kind, const std::string& functionId, const std::string& combinerId,
+			std::vector<Communication::SerializedData>&& tasks, const std::vector<uint64_t>& inputHashes,
+			std::vector<Communication::Buffer>& results, const std::vector<size_t>& placement = {});
+
+		/** Places every partition on a Slave that already holds it, if any, and sends the payload only to the other Slaves. */
+		int dispatchDataset(Communication::TaskKind kind, const std::string& functionId, const std::string& combinerId,
+			const std::vector<Communication::Buffer>& partitions, const std::vector<Communication::DatasetId>& ids,
+			std::vector<Communication::Buffer>& results);
+
+		/** Blocks until one of the busy Slaves replies or takes its queued tasks, at most until the deadline. */
+		void waitForReplies(const std::vector<Communication::ClientSocket *>& busy, const Communication::Deadline& deadline);
+		/** Closes the connections of the Slaves marked in lost and forgets them, the next operations use the others. */
+		void disconnect(const std::vector<bool>& lost);
+
+		/** At most one partition per Slave, preferring the Slaves where the partition is resident. */
+		std::vector<size_t> place(const std::vector<Communication::DatasetId>& ids) const;
+
+		template<typename Out> int concatenate(const std::vector<Communication::Buffer>& results, size_t elementCount, std::vector<Out>& output) const
+		{
+			output.clear();
+			output.reserve(elementCount);
+			for (const Communication::Buffer& result : results)
+				for (Out& value : Communication::SerializerSelector<std::vector<Out>>::deserialize(result))
+					output.push_back(std::move(value));
+			return ERROR_SUCCESS;
+		}
+
+		/** The hash of every partition is computed while the partition is serialized. */
+		template<typename In> std::vector<Communication::SerializedData> serializePartitions(const std::vector<In>& input, std::vector<uint64_t>& inputHashes) const
+		{
+			std::vector<Communication::SerializedData> tasks;
+			inputHashes.clear();
+			for (auto& range : partition(input.size()))
+			{
+				Communication::Hasher hasher;
+				tasks.emplace_back();
+				tasks.back().addBuffer(Communication::TaskField::input,
+					Communication::BasicSerializer<std::vector<In>>::serializeRange(input.data() + range.first, range.second - range.first, &hasher));
+				inputHashes.push_back(hasher.digest());
+			}
+			return tasks;
+		}
+
+		template<typename Type> int merge(const std::string& combinerId, const std::vector<Communication::Buffer>& partials, Type& output) const
+		{
+			const Communication::FunctionRegistry::CombineFunction* combine = Communication::FunctionRegistry::instance().findCombine(combinerId);
+			if (combine == nullptr)
+			{
+				_log_("Functia reduce \"", combinerId, "\" nu este inregistrata pe Master.");
+				return ERROR_INVALID_FUNCTION;
+			}
+			if (partials.empty())
+			{
+				_log_("Nu exista rezultate partiale de combinat.");
+				return ERROR_NO_DATA;
+			}
+
+			std::vector<const Communication::Buffer *> parts;
+			Communication::Buffer count = Communication::BasicSerializer<size_t>::serialize(partials.size());
+			parts.push_back(&count);
+			for (const Communication::Buffer& partial : partials)
+				parts.push_back(&partial);
+			Communication::Buffer values = Communication::Buffer::packBuffers(parts, Communication::Buffer::BufferType::Vector);
+
+			output = Communication::SerializerSelector<Type>::deserialize((*combine)(values));
+			return ERROR_SUCCESS;
+		}
+	};
+}
@@ -0,0 +1,138 @@
+#include "LocalLauncher.hpp"
+#include <memory>
+
+using namespace Communication;
+
+
+namespace Master
+{
+	LocalLauncher::~LocalLauncher()
+	{
+		for (HANDLE process : processes)
+			CloseHandle(process);
+	}
+
+	int LocalLauncher::launch(size_t slaveCount, int port, const std::string& slavePath)
+	{
+		std::string path = slavePath;
+		if (path.empty())
+		{
+			char modulePath[MAX_PATH];
+			const DWORD length = GetModuleFileNameA(nullptr, modulePath, MAX_PATH);
+			if (length == 0 || length == MAX_PATH)
+			{
+				int error = GetLastError();
+				_log_("Nu s-a putut afla calea executabilului, error = ", error);
+				return error != ERROR_SUCCESS ? error : ERROR_INSUFFICIENT_BUFFER;
+			}
+			path.assign(modulePath, length);
+			path = path.substr(0, path.find_last_of("\\/") + 1) + "Slave.exe";
+		}
+
+		// The loopback address, so the Slaves do not resolve any name
+		const std::string commandLine = "\"" + path + "\" 127.0.0.1 " + std::to_string(port);
+		for (const Placement& placement : plan(slaveCount))
+			if (int error = start(commandLine, placement); error)
+				return error;
+		return ERROR_SUCCESS;
+	}
+
+	std::vector<LocalLauncher::Placement> LocalLauncher::plan(size_t slaveCount)
+	{
+		std::vector<Placement> nodes;
+		ULONG highestNode = 0;
+		if (GetNumaHighestNodeNumber(&highestNode))
+			for (ULONG node = 0; node <= highestNode; node++)
+			{
+				Placement placement;
+				placement.node = USHORT(node);
+				if (GetNumaNodeProcessorMaskEx(placement.node, &placement.affinity) && placement.affinity.Mask != 0)
+					nodes.push_back(placement);
+			}
+
+		// Without NUMA information the Slaves are left to the scheduler, an empty mask means not pinned
+		std::vector<Placement> placements(slaveCount);
+		if (nodes.empty())
+			return placements;
+
+		for (size_t node = 0; node < nodes.size(); node++)
+		{
+			// Slaves node, node + nodes.size(), ... share the processors of the node
+			const size_t sharing = slaveCount / nodes.size() + (node < slaveCount % nodes.size() ? 1 : 0);
+			std::vector<KAFFINITY> processors;
+			for (KAFFINITY processor = 1; processor != 0; processor <<= 1)
+				if (nodes[node].affinity.Mask & processor)
+					processors.push_back(processor);
+
+			for (size_t k = 0; k < sharing; k++)
+			{
+				Placement& placement = placements[node + k * nodes.size()];
+				placement = nodes[node];
+				placement.affinity.Mask = 0;
+				if (sharing <= processors.size())
+					for (size_t i = k * processors.size() / sharing; i < (k + 1) * processors.size() / sharing; i++)
+						placement.affinity.Mask |= processors[i];
+				else
+					placement.affinity.Mask = processors[k % processors.size()];
+			}
+		}
+		return placements;
+	}
+
+	int LocalLauncher::start(const std::string& commandLine, const Placement& placement)
+	{
+		const bool pinned = placement.affinity.Mask != 0;
+
+		// The preferred node and the processor group are given to the process when it is created
+		SIZE_T attributesSize = 0;
+		InitializeProcThreadAttributeList(nullptr, 2, 0, &attributesSize);
+		std::unique_ptr<char[]> attributesStorage(new char[attributesSize]);
+		LPPROC_THREAD_ATTRIBUTE_LIST attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributesStorage.get());
+		if (!InitializeProcThreadAttributeList(attributes, 2, 0, &attributesSize))
+		{
+			int error = GetLastError();
+			_log_("Nu s-au putut pregati atributele procesului, error = ", error);
+			return error;
+		}
+		ScopeGuard deleteAttributes([attributes] { DeleteProcThreadAttributeList(attributes); });
+
+		USHORT node = placement.node;
+		GROUP_AFFINITY affinity = placement.affinity;
+		if (pinned && (!UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_PREFERRED_NODE, &node, sizeof(node), nullptr, nullptr)
+			|| !UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_GROUP_AFFINITY, &affinity, sizeof(affinity), nullptr, nullptr)))
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut fixa nodul NUMA ", node, " pentru Slave, error = ", error);
+			return error;
+		}
+
+		STARTUPINFOEXA startupInfo = {};
+		startupInfo.StartupInfo.cb = sizeof(startupInfo);
+		startupInfo.lpAttributeList = attributes;
+		PROCESS_INFORMATION process = {};
+		std::string arguments = commandLine;		// CreateProcessA may write to it
+
+		// Suspended until the whole process is pinned, so no thread starts on other processors
+		if (!CreateProcessA(nullptr, &arguments[0], nullptr, nullptr, FALSE, CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT,
+			nullptr, nullptr, &startupInfo.StartupInfo, &process))
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut porni Slave-ul ", commandLine, ", error = ", error);
+			return error;
+		}
+		ScopeGuard closeThread([&process] { CloseHandle(process.hThread); });
+
+		// The group affinity pins the first thread, the process mask the threads created later
+		if (pinned && !SetProcessAffinityMask(process.hProcess, placement.affinity.Mask))
+		{
+			int error = GetLastError();
+			_log_("Nu s-au putut fixa procesoarele Slave-ului, error = ", error);
+			TerminateProcess(process.hProcess, 1);
+			CloseHandle(process.hProcess);
+			return error;
+		}
+		ResumeThread(process.hThread);
+		processes.push_back(process.hProcess);
+		return ERROR_SUCCESS;
+	}
+}
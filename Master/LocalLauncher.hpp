@@ -0,0 +1,48 @@
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+#include <vector>
+#include <Communication.hpp>
+
+namespace Master
+{
+	/**
+	 * Starts Slave processes on this machine, spread over the NUMA nodes. Every Slave runs on its own processors
+	 * of one node, its worker threads included, and takes its memory from that node: pages are allocated on the
+	 * node of the processor that touches them first, the preferred node of the process otherwise.
+	 * The Slaves connect back over loopback and exit when the Cluster shuts them down.
+	 */
+	class LocalLauncher
+	{
+	public:
+		/** Where a Slave runs. */
+		struct Placement
+		{
+			USHORT node = 0;
+			GROUP_AFFINITY affinity = {};
+		};
+
+	private:
+		std::vector<HANDLE> processes;
+
+	public:
+		LocalLauncher() = default;
+		~LocalLauncher();
+		LocalLauncher(const LocalLauncher&) = delete;
+		void operator =(const LocalLauncher&) = delete;
+
+		/** Starts slaveCount instances of slavePath (Slave.exe next to this executable if empty), connecting to port. */
+		int launch(size_t slaveCount, int port, const std::string& slavePath = "");
+		size_t getSlaveCount() const { return processes.size(); }
+
+		/**
+		 * Slaves go round-robin over the nodes and the processors of a node are split between its Slaves,
+		 * so no two Slaves share a processor unless there are more Slaves than processors.
+		 */
+		static std::vector<Placement> plan(size_t slaveCount);
+
+	private:
+		int start(const std::string& commandLine, const Placement& placement);
+	};
+}
@@ -1,7 +1,66 @@
 #include <iostream>
+#include <numeric>
+#include "Cluster.hpp"
+#include "LocalLauncher.hpp"
 
-int main()
+using namespace Communication;
+
+int main(int argc, char* argv[])
 {
-    std::cout << "Hello World!\n"; 
+	const size_t slaveCount = argc > 1 ? std::stoul(argv[1]) : 1;
+	const int port = argc > 2 ? std::stoi(argv[2]) : defaultMasterPort;
+	const bool launchLocal = argc > 3 && std::string(argv[3]) == "local";		// Starts the Slaves on this machine
+	const std::string capturePath = argc > 4 ? argv[4] : "";			// Records the traffic of every Slave, see Replay
+	registerBuiltinFunctions();
+
+	ServerSocket* server = CreateServerSocket();
+	ScopeGuard deleteServer([server] { DeleteServerSocket(server); });
+	server->enableFlowControl();		// A slow Slave gets its tasks queued instead of blocking the others
+	server->enableChannels();			// Control messages are not held back by large partitions
+	server->enableRegisteredIo();		// The transfers of all the Slaves complete through one queue
+	if (!capturePath.empty())
+		if (int error = server->enableCapture(capturePath); error)
+			exitWithError("Nu s-a putut porni captura traficului, error = ", error);
+	if (int error = server->bind(port); error)
+		exitWithError("Nu s-a putut face bind pe portul ", port, ", error = ", error);
+	if (int error = server->listen(int(slaveCount)); error)
+		exitWithError("Nu s-a putut asculta pe portul ", port, ", error = ", error);
+
+	Master::LocalLauncher launcher;
+	if (launchLocal)
+		if (int error = launcher.launch(slaveCount, port); error)
+			exitWithError("Nu s-au putut porni Slave-urile locale, error = ", error);
+
+	Master::Cluster cluster;
+	if (int error = cluster.acceptSlaves(*server, slaveCount); error)
+		exitWithError("Nu s-au putut conecta Slave-urile, error = ", error);
+	cluster.setTaskTimeout(std::chrono::minutes(1));		// A Slave that died does not hang the Master
+
+	std::vector<int> values(1000);
+	std::iota(values.begin(), values.end(), 1);
+	Master::Dataset<int> dataset;
+	cluster.createDataset(values, dataset);
+
+	// The partitions are sent only by the first operation, the second one finds them on the Slaves
+	int sumOfSquares = 0, maximum = 0;
+	if (int error = cluster.parallelMapReduce(dataset, "int.square", "int.sum", sumOfSquares); error)
+		exitWithError("Calculul a esuat, error = ", error);
+	if (int error = cluster.parallelReduce(dataset, "int.max", maximum); error)
+		exitWithError("Calculul a esuat, error = ", error);
+	std::cout << "Suma patratelor: " << sumOfSquares << ", maximul: " << maximum << '\n';
+
+	// The partial sums stay on the Slaves that computed them, the Master only gets the total
+	Master::TaskGraph graph;
+	const size_t half = values.size() / 2;
+	auto low = graph.addMap(std::vector<int>(values.begin(), values.begin() + half), "int.square", "int.sum");
+	auto high = graph.addMap(std::vector<int>(values.begin() + half, values.end()), "int.square", "int.sum");
+	auto total = graph.addReduce({ low, high }, "int.sum");
+	graph.fetch(total);
+	std::vector<Buffer> outputs;
+	if (int error = cluster.run(graph, outputs); error)
+		exitWithError("Graful de task-uri a esuat, error = ", error);
+	std::cout << "Suma patratelor, din graf: " << SerializerSelector<int>::deserialize(outputs[total]) << '\n';
+
+	cluster.shutdown();
 	std::cin.get();
 }
@@ -0,0 +1,137 @@
+#include "ResultCache.hpp"
+
+using namespace Communication;
+
+
+namespace Master
+{
+	int ResultCache::SpillFile::open(const std::string& path, size_t capacity)
+	{
+		close();
+
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut crea fisierul \"", path, "\", error = ", error);
+			return error;
+		}
+
+		const unsigned long long size = capacity;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size & 0xFFFFFFFF), nullptr);
+		if (mapping == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut mapa fisierul \"", path, "\" de ", capacity, " bytes, error = ", error);
+			close();
+			return error;
+		}
+
+		view = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity));
+		if (view == nullptr)
+		{
+			int error = GetLastError();
+			_log_("Nu s-a putut mapa in memorie fisierul \"", path, "\", error = ", error);
+			close();
+			return error;
+		}
+
+		this->capacity = capacity;
+		usedSize = 0;
+		index.clear();
+		return ERROR_SUCCESS;
+	}
+
+	void ResultCache::SpillFile::close()
+	{
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		view = nullptr;
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+		index.clear();
+	}
+
+	void ResultCache::SpillFile::write(DatasetId key, const Buffer& result)
+	{
+		if (!isOpen() || result.getSize() > capacity || index.count(key))
+			return;
+		if (usedSize + result.getSize() > capacity)
+		{
+			// The oldest results are overwritten
+			index.clear();
+			usedSize = 0;
+		}
+
+		std::memcpy(view + usedSize, result, result.getSize());
+		index[key] = { usedSize, result.getSize() };
+		usedSize += result.getSize();
+	}
+
+	bool ResultCache::SpillFile::read(DatasetId key, Buffer& result) const
+	{
+		auto it = index.find(key);
+		if (it == index.end())
+			return false;
+
+		void* bytes = std::malloc(it->second.second);
+		if (bytes == nullptr)
+		{
+			_log_("Nu s-a putut aloca o zona de memorie de ", it->second.second, " bytes.");
+			return false;
+		}
+		std::memcpy(bytes, view + it->second.first, it->second.second);
+		result = Buffer(std::move(bytes));
+		return true;
+	}
+
+
+	ResultCache::ResultCache(size_t memoryCapacity)
+		: memory(memoryCapacity)
+	{
+		memory.setEvictionHandler([this](DatasetId key, Buffer&& result) { spill.write(key, result); });
+	}
+
+	int ResultCache::enableSpill(const std::string& path, size_t spillCapacity)
+	{
+		return spill.open(path, spillCapacity);
+	}
+
+	DatasetId ResultCache::getKey(TaskKind kind, const std::string& functionId, const std::string& combinerId, uint64_t inputHash)
+	{
+		Hasher hasher(inputHash);
+		const int kindValue = int(kind);
+		hasher.update(&kindValue, sizeof(kindValue));
+		hasher.update(functionId.c_str(), functionId.length() + 1);
+		hasher.update(combinerId.c_str(), combinerId.length() + 1);
+		return DatasetId(hasher.digest());
+	}
+
+	bool ResultCache::find(DatasetId key, Buffer& result)
+	{
+		if (const Buffer* cached = memory.find(key))
+		{
+			result = Buffer(*cached);
+			hits++;
+			return true;
+		}
+		if (spill.read(key, result))
+		{
+			hits++;
+			return true;
+		}
+		misses++;
+		return false;
+	}
+
+	void ResultCache::insert(DatasetId key, const Buffer& result)
+	{
+		std::vector<DatasetId> evicted;
+		memory.insert(key, Buffer(result), evicted);
+	}
+}
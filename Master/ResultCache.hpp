@@ -0,0 +1,63 @@
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+#include <unordered_map>
+#include <Communication.hpp>
+#include <DatasetCache.hpp>
+#include <Task.hpp>
+
+namespace Master
+{
+	/**
+	 * Results of already executed tasks, keyed by the hash of the function and of the serialized input.
+	 * Recent results are kept in memory; the evicted ones can be spilled to a memory-mapped file.
+	 * Only valid for functions whose result depends on nothing but their input.
+	 */
+	class ResultCache
+	{
+		/** Append-only region of a memory-mapped file, restarted from the beginning when full. */
+		class SpillFile
+		{
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+			char* view = nullptr;
+			size_t capacity = 0;
+			size_t usedSize = 0;
+			std::unordered_map<Communication::DatasetId, std::pair<size_t, size_t>> index;		// Offset and size of every result
+
+		public:
+			~SpillFile() { close(); }
+
+			int open(const std::string& path, size_t capacity);
+			void close();
+			bool isOpen() const { return view != nullptr; }
+
+			void write(Communication::DatasetId key, const Communication::Buffer& result);
+			bool read(Communication::DatasetId key, Communication::Buffer& result) const;
+		};
+
+		Communication::DatasetCache memory;
+		SpillFile spill;
+		size_t hits = 0;
+		size_t misses = 0;
+
+	public:
+		explicit ResultCache(size_t memoryCapacity);
+		ResultCache(const ResultCache&) = delete;
+		void operator =(const ResultCache&) = delete;
+
+		/** Results evicted from memory are written to the file at path, which holds at most spillCapacity bytes. */
+		int enableSpill(const std::string& path, size_t spillCapacity);
+
+		/** The key of a task, inputHash is the hash of the serialized input computed while it was packed. */
+		static Communication::DatasetId getKey(Communication::TaskKind kind, const std::string& functionId, const std::string& combinerId, uint64_t inputHash);
+
+		/** Copies the cached result, if any. */
+		bool find(Communication::DatasetId key, Communication::Buffer& result);
+		void insert(Communication::DatasetId key, const Communication::Buffer& result);
+
+		size_t getHitCount() const { return hits; }
+		size_t getMissCount() const { return misses; }
+	};
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <Communication.hpp>
+#include <Task.hpp>
+
+namespace Master
+{
+	/**
+	 * Tasks and the tasks whose outputs they take as input, run by Cluster::run without barriers between stages:
+	 * a task starts as soon as its inputs are computed, preferably on the Slave that holds most of them. The outputs
+	 * stay on the Slaves, which get them from each other when needed; only the fetched ones reach the Master.
+	 * A node may only depend on nodes added before it, so the graph has no cycles.
+	 */
+	class TaskGraph
+	{
+		friend class Cluster;
+
+	public:
+		using NodeId = size_t;
+		/** Returned for a node that was not added: a dependency is not an earlier node; Cluster::run then fails. */
+		static constexpr NodeId invalidNode = NodeId(-1);
+
+	private:
+		struct Node
+		{
+			Communication::TaskKind kind;
+			std::string functionId;
+			std::string combinerId;
+			Communication::Buffer input;		// Given by the application, for the nodes without dependencies
+			std::vector<NodeId> dependencies;	// Their outputs are the input, For nodes only wait for them
+			size_t begin = 0, end = 0;
+			bool fetched = false;
+		};
+
+		std::vector<Node> nodes;
+		bool rejected = false;
+
+	public:
+		/** Maps the input, then combines the mapped values if combinerId is given. */
+		template<typename In> NodeId addMap(const std::vector<In>& input, const std::string& functionId, const std::string& combinerId = "")
+		{
+			Node node;
+			node.kind = Communication::TaskKind::Map;
+			node.functionId = functionId;
+			node.combinerId = combinerId;
+			node.input = Communication::SerializerSelector<std::vector<In>>::serialize(input);
+			return add(std::move(node));
+		}
+		/** Maps the output of dependency, a std::vector. */
+		NodeId addMap(NodeId dependency, const std::string& functionId, const std::string& combinerId = "")
+		{
+			Node node;
+			node.kind = Communication::TaskKind::Map;
+			node.functionId = functionId;
+			node.combinerId = combinerId;
+			node.dependencies.push_back(dependency);
+			return add(std::move(node));
+		}
+		/**
+		 * Folds the output of a single dependency, a std::vector, or the outputs of several dependencies,
+		 * one value each (e.g. Reduce nodes or Map nodes with a combiner).
+		 */
+		NodeId addReduce(const std::vector<NodeId>& dependencies, const std::string& functionId)
+		{
+			Node node;
+			node.kind = Communication::TaskKind::Reduce;
+			node.functionId = functionId;
+			node.dependencies = dependencies;
+			return add(std::move(node));
+		}
+		/** Calls the function for every index in [begin, end), after the nodes in after. */
+		NodeId addFor(size_t begin, size_t end, const std::string& functionId, const std::vector<NodeId>& after = {})
+		{
+			Node node;
+			node.kind = Communication::TaskKind::For;
+			node.functionId = functionId;
+			node.dependencies = after;
+			node.begin = begin;
+			node.end = end;
+			return add(std::move(node));
+		}
+
+		/** The output of the node is sent to the Master, see Cluster::run. */
+		void fetch(NodeId node)
+		{
+			if (node >= nodes.size())
+			{
+				_log_("Nodul ", node, " nu exista in graf.");
+				rejected = true;
+				return;
+			}
+			nodes[node].fetched = true;
+		}
+		size_t getNodeCount() const { return nodes.size(); }
+
+	private:
+		/** Checked in Release too, Cluster::run indexes its tables with the dependencies. */
+		NodeId add(Node&& node)
+		{
+			for (NodeId dependency : node.dependencies)
+				if (dependency >= nodes.size())
+				{
+					_log_("Nodul ", nodes.size(), " depinde de nodul ", dependency, " care nu exista inca.");
+					rejected = true;
+					return invalidNode;
+				}
+			if (node.kind == Communication::TaskKind::Map && node.dependencies.size() > 1)
+			{
+				_log_("Un nod map are cel mult o dependenta.");
+				rejected = true;
+				return invalidNode;
+			}
+			nodes.push_back(std::move(node));
+			return nodes.size() - 1;
+		}
+	};
+}
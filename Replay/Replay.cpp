@@ -0,0 +1,142 @@
+#include <winsock2.h>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <Communication.hpp>
+#include <Task.hpp>
+#include <TrafficCapture.hpp>
+
+using namespace Communication;
+
+/**
+ * Plays back the capture of one end of a connection (see ClientSocket::enableCapture) against a real other end:
+ *     Replay master <capture> [port] [speed]          takes the place of the Master, one Slave connects to it
+ *     Replay slave <capture> [host] [port] [speed]    takes the place of a Slave and connects to a Master
+ * The captured frames are sent in their order, each once the frames received before it in the capture arrived and
+ * not before its time divided by speed (1 keeps the original pace, 0 sends as fast as possible). The frames that
+ * arrive are compared with the captured ones, so a change in the way the other end answers shows up.
+ */
+
+/** How long a frame of the capture is waited for before the replay gives up. */
+constexpr std::chrono::minutes receiveTimeout(1);
+
+struct ReplayStatistics
+{
+	size_t sentFrames = 0, sentBytes = 0;
+	size_t receivedFrames = 0, receivedBytes = 0;
+	size_t differentFrames = 0;			// Received with other bytes than in the capture
+	double totalResponse = 0, maxResponse = 0;		// Seconds from the last frame sent to each frame received
+};
+
+static int replay(CaptureReader& capture, ClientSocket& peer, double speed, ReplayStatistics& statistics)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+	Clock::time_point lastSent = start;
+	CaptureReader::Record record;
+	Buffer received;
+	while (capture.next(record))
+	{
+		if (record.direction == TrafficCapture::Direction::Received)
+		{
+			// From the channel of the record: with Any, a frame of another channel that arrives sooner than in the capture
+			// would be compared with this record
+			if (int error = peer.receiveBuffer(received, record.channel, Deadline::after(receiveTimeout)); error)
+			{
+				_log_("Frame-ul ", statistics.receivedFrames, " al capturii nu a fost primit, error = ", error);
+				return error;
+			}
+			const double response = std::chrono::duration<double>(Clock::now() - lastSent).count();
+			statistics.totalResponse += response;
+			statistics.maxResponse = std::max(statistics.maxResponse, response);
+			statistics.receivedFrames++;
+			statistics.receivedBytes += received.getSize();
+			if (received.getSize() != record.frame.getSize() || std::memcmp(received, record.frame, received.getSize()) != 0)
+				statistics.differentFrames++;
+			continue;
+		}
+
+		if (speed > 0)
+		{
+			const Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(record.time) / speed);
+			if (due > Clock::now())
+				Sleep(DWORD(std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count()));
+		}
+		if (int error = peer.sendBuffer(record.frame, record.channel); error)
+		{
+			_log_("Frame-ul ", statistics.sentFrames, " al capturii nu a putut fi trimis, error = ", error);
+			return error;
+		}
+		lastSent = Clock::now();
+		statistics.sentFrames++;
+		statistics.sentBytes += record.frame.getSize();
+	}
+	return ERROR_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3 || (std::string(argv[1]) != "master" && std::string(argv[1]) != "slave"))
+	{
+		std::cout << "Utilizare: Replay master <captura> [port] [viteza]\n"
+			"           Replay slave <captura> [host] [port] [viteza]\n";
+		return 1;
+	}
+	const bool asMaster = std::string(argv[1]) == "master";
+	const std::string path = argv[2];
+	const std::string hostname = !asMaster && argc > 3 ? argv[3] : "localhost";
+	const int portArgument = asMaster ? 3 : 4;
+	const int port = argc > portArgument ? std::stoi(argv[portArgument]) : defaultMasterPort;
+	const double speed = argc > portArgument + 1 ? std::stod(argv[portArgument + 1]) : 1;
+
+	CaptureReader capture;
+	if (int error = capture.open(path); error)
+		exitWithError("Nu s-a putut deschide captura \"", path, "\", error = ", error);
+
+	// The connection is set up like the one of the Master and the Slaves
+	ServerSocket* server = nullptr;
+	ClientSocket* peer = nullptr;
+	ScopeGuard deleteSockets([&server, &peer]
+	{
+		if (peer != nullptr)
+			DeleteClientSocket(peer);
+		if (server != nullptr)
+			DeleteServerSocket(server);
+	});
+	if (asMaster)
+	{
+		server = CreateServerSocket();
+		server->enableFlowControl();
+		server->enableChannels();
+		if (int error = server->bind(port); error)
+			exitWithError("Nu s-a putut face bind pe portul ", port, ", error = ", error);
+		if (int error = server->listen(1); error)
+			exitWithError("Nu s-a putut asculta pe portul ", port, ", error = ", error);
+		if (int error = server->acceptClient(peer, Deadline()); error)
+			exitWithError("Nu s-a putut accepta Slave-ul, error = ", error);
+	}
+	else
+	{
+		peer = CreateClientSocket();
+		peer->enableFlowControl();
+		peer->enableChannels();
+		if (int error = peer->connect(hostname, port); error)
+			exitWithError("Nu s-a putut realiza conexiunea la Master, error = ", error);
+	}
+
+	ReplayStatistics statistics;
+	const auto start = std::chrono::steady_clock::now();
+	const int error = replay(capture, *peer, speed, statistics);
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Trimise: " << statistics.sentFrames << " frame-uri, " << statistics.sentBytes << " bytes\n"
+		<< "Primite: " << statistics.receivedFrames << " frame-uri, " << statistics.receivedBytes << " bytes, "
+		<< statistics.differentFrames << " diferite de captura\n"
+		<< "Durata: " << elapsed << " s";
+	if (statistics.receivedFrames > 0)
+		std::cout << ", raspuns mediu " << 1000 * statistics.totalResponse / statistics.receivedFrames
+			<< " ms, maxim " << 1000 * statistics.maxResponse << " ms";
+	std::cout << '\n';
+	return error == ERROR_SUCCESS ? 0 : 1;
+}
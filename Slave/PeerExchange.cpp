@@ -0,0 +1,173 @@
+#include "PeerExchange.hpp"
+
+using namespace Communication;
+
+
+/** Slaves that may wait at once to connect to this one. */
+constexpr int peerBacklog = 16;
+
+PeerExchange::~PeerExchange()
+{
+	if (server == nullptr)
+		return;
+
+	// No handler starts after the acceptor ended, the others return once their peers are cancelled
+	server->cancel();
+	if (acceptor.joinable())
+		acceptor.join();
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		for (ClientSocket* peer : peers)
+			peer->cancel();
+	}
+	for (std::thread& handler : handlers)
+		handler.join();
+
+	for (ClientSocket* peer : peers)
+		DeleteClientSocket(peer);
+	for (auto& connection : connections)
+		DeleteClientSocket(connection.second);
+	DeleteServerSocket(server);
+}
+
+int PeerExchange::start()
+{
+	server = CreateServerSocket();
+	if (int error = server->bind(0); error)
+	{
+		_log_("Nu s-a putut face bind pentru celelalte Slave-uri, error = ", error);
+		return error;
+	}
+	if (int error = server->listen(peerBacklog); error)
+	{
+		_log_("Nu s-a putut asculta pentru celelalte Slave-uri, error = ", error);
+		return error;
+	}
+	acceptor = std::thread(&PeerExchange::accept, this);
+	return ERROR_SUCCESS;
+}
+
+void PeerExchange::keep(DatasetId id, Buffer&& output)
+{
+	std::shared_ptr<const Buffer> kept = std::make_shared<const Buffer>(std::move(output));
+	std::lock_guard<std::mutex> guard(mutex);
+	outputs[id] = std::move(kept);
+}
+
+std::shared_ptr<const Buffer> PeerExchange::find(DatasetId id)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	auto found = outputs.find(id);
+	return found != outputs.end() ? found->second : nullptr;
+}
+
+void PeerExchange::release(const std::vector<DatasetId>& ids)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	for (DatasetId id : ids)
+		outputs.erase(id);
+}
+
+void PeerExchange::accept()
+{
+	for (;;)
+	{
+		ClientSocket* peer = nullptr;
+		if (int error = server->acceptClient(peer, Deadline()); error)
+		{
+			if (error != ERROR_CANCELLED)
+				_log_("Nu s-a putut accepta un Slave, error = ", error);
+			return;
+		}
+		std::lock_guard<std::mutex> guard(mutex);
+		peers.push_back(peer);
+		handlers.emplace_back(&PeerExchange::serve, this, peer);
+	}
+}
+
+void PeerExchange::serve(ClientSocket* peer)
+{
+	Buffer message;
+	while (peer->receiveBuffer(message) == ERROR_SUCCESS)
+	{
+		SerializedData request = SerializedData::view(message);
+		int kind = int(TaskKind::Shutdown);
+		DatasetId id = 0;
+		request.peek(TaskField::kind, kind);
+		request.peek(TaskField::output, id);
+		std::shared_ptr<const Buffer> output = TaskKind(kind) == TaskKind::Fetch ? find(id) : nullptr;
+
+		// The output is sent as it is, not copied into the reply
+		SerializedData reply;
+		reply.add(TaskField::status, output != nullptr ? ERROR_SUCCESS : ERROR_NOT_FOUND);
+		if (peer->sendBuffer(reply) != ERROR_SUCCESS)
+			return;
+		if (output != nullptr && peer->sendBuffer(*output) != ERROR_SUCCESS)
+			return;
+	}
+}
+
+int PeerExchange::connect(const std::string& source, ClientSocket*& peer)
+{
+	auto found = connections.find(source);
+	if (found != connections.end())
+	{
+		peer = found->second;
+		return ERROR_SUCCESS;
+	}
+
+	const size_t separator = source.rfind(':');
+	if (separator == std::string::npos)
+	{
+		_log_("Adresa \"", source, "\" nu are port.");
+		return ERROR_INVALID_PARAMETER;
+	}
+	peer = CreateClientSocket();
+	if (int error = peer->connect(source.substr(0, separator), std::stoi(source.substr(separator + 1))); error)
+	{
+		_log_("Nu s-a putut realiza conexiunea la Slave-ul ", source, ", error = ", error);
+		DeleteClientSocket(peer);
+		peer = nullptr;
+		return error;
+	}
+	connections.emplace(source, peer);
+	return ERROR_SUCCESS;
+}
+
+int PeerExchange::fetch(const std::string& source, DatasetId id, Buffer& output)
+{
+	ClientSocket* peer = nullptr;
+	if (int error = connect(source, peer); error)
+		return error;
+
+	SerializedData request;
+	request.add(TaskField::kind, int(TaskKind::Fetch));
+	request.add(TaskField::output, id);
+	Buffer message;
+	int error = peer->sendBuffer(request);
+	if (!error)
+		error = peer->receiveBuffer(message);
+	if (error)
+	{
+		// The connection is opened again by the next fetch
+		_log_("Transferul de la Slave-ul ", source, " a esuat, error = ", error);
+		connections.erase(source);
+		DeleteClientSocket(peer);
+		return error;
+	}
+
+	int status = ERROR_NOT_FOUND;
+	SerializedData::view(message).peek(TaskField::status, status);
+	if (status != ERROR_SUCCESS)
+	{
+		_log_("Slave-ul ", source, " nu are rezultatul ", id, ".");
+		return status;
+	}
+	if (error = peer->receiveBuffer(output); error)
+	{
+		_log_("Transferul de la Slave-ul ", source, " a esuat, error = ", error);
+		connections.erase(source);
+		DeleteClientSocket(peer);
+	}
+	return error;
+}
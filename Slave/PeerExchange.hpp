@@ -0,0 +1,53 @@
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <Communication.hpp>
+#include <DatasetCache.hpp>
+#include <Task.hpp>
+
+/**
+ * The outputs of task graph nodes kept on this Slave, until the Master releases them, and the transfers between
+ * Slaves: a node placed here whose inputs are on other Slaves gets them from those Slaves directly, the Master
+ * only tells it where they are. The other Slaves are served by threads of their own, next to the task loop.
+ */
+class PeerExchange
+{
+	Communication::ServerSocket* server = nullptr;
+	std::thread acceptor;
+	std::vector<std::thread> handlers;							// One for every Slave connected here
+	std::vector<Communication::ClientSocket *> peers;			// Served by the handlers
+	std::unordered_map<std::string, Communication::ClientSocket *> connections;		// To the Slaves fetched from, by address
+
+	std::unordered_map<Communication::DatasetId, std::shared_ptr<const Communication::Buffer>> outputs;
+	std::mutex mutex;
+
+public:
+	PeerExchange() = default;
+	~PeerExchange();
+	PeerExchange(const PeerExchange&) = delete;
+	void operator =(const PeerExchange&) = delete;
+
+	/** Listens on a port picked by the system, see getPort. */
+	int start();
+	int getPort() const { return server != nullptr ? server->getPort() : 0; }
+
+	void keep(Communication::DatasetId id, Communication::Buffer&& output);
+	/** nullptr if the output is not kept here; the buffer stays valid after it is released. */
+	std::shared_ptr<const Communication::Buffer> find(Communication::DatasetId id);
+	void release(const std::vector<Communication::DatasetId>& ids);
+
+	/** Gets an output kept on the Slave at source ("host:port"), the connection is reused by the next fetches. */
+	int fetch(const std::string& source, Communication::DatasetId id, Communication::Buffer& output);
+
+private:
+	void accept();
+	/** Answers the fetches of a Slave with a status, then the output itself, until it disconnects. */
+	void serve(Communication::ClientSocket* peer);
+	int connect(const std::string& source, Communication::ClientSocket*& peer);
+};
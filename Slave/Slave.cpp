@@ -1,7 +1,210 @@
+#include <winsock2.h>
 #include <iostream>
+#include <string>
+#include <Communication.hpp>
+#include <DatasetCache.hpp>
+#include <FunctionRegistry.hpp>
+#include <Task.hpp>
+#include "PeerExchange.hpp"
 
-int main()
+using namespace Communication;
+
+/**
+ * The input is either sent with the task or, for datasets already resident on this Slave, only referenced by id.
+ * The input sent with the task is read in place from the received frame, inlineInput being a view of it;
+ * only datasets are copied, into the cache, since the frame is reused by the next task. Returns nullptr if there is no input.
+ */
+static const Buffer* resolveInput(SerializedData& task, DatasetCache& cache, Buffer& inlineInput, bool& resident, std::vector<DatasetId>& evicted)
+{
+	DatasetId datasetId = 0;
+	const bool isDataset = task.peek(TaskField::datasetId, datasetId);
+	const bool hasPayload = task.viewBuffer(TaskField::input, inlineInput);
+	if (!isDataset)
+		return hasPayload ? &inlineInput : nullptr;
+
+	const Buffer* input = cache.find(datasetId);
+	if (input == nullptr && hasPayload && inlineInput.getSize() <= cache.getCapacity())
+		input = cache.insert(datasetId, Buffer(inlineInput), evicted);
+	resident = input != nullptr;
+	if (input == nullptr && hasPayload)		// Larger than the whole cache, used only for this task
+		return &inlineInput;
+	return input;
+}
+
+/**
+ * The outputs of other task graph nodes taken as input, kept on this Slave or fetched from the Slaves holding them.
+ * Several outputs are packed like the partial results merged on the Master, their count followed by them.
+ */
+static int resolveIntermediates(SerializedData& task, PeerExchange& exchange, std::shared_ptr<const Buffer>& input)
+{
+	std::vector<DatasetId> ids;
+	std::vector<std::string> sources;
+	task.peek(TaskField::inputs, ids);
+	task.peek(TaskField::sources, sources);
+	if (ids.empty() || ids.size() != sources.size())
+		return ERROR_INVALID_PARAMETER;
+
+	std::vector<std::shared_ptr<const Buffer>> parts;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		if (sources[i].empty())
+			parts.push_back(exchange.find(ids[i]));
+		else
+		{
+			Buffer fetched;
+			if (int error = exchange.fetch(sources[i], ids[i], fetched); error)
+				return error;
+			parts.push_back(std::make_shared<const Buffer>(std::move(fetched)));
+		}
+		if (parts.back() == nullptr)
+			return ERROR_NOT_FOUND;
+	}
+	if (parts.size() == 1)
+	{
+		input = parts.front();
+		return ERROR_SUCCESS;
+	}
+
+	std::vector<const Buffer *> buffers;
+	Buffer count = BasicSerializer<size_t>::serialize(parts.size());
+	buffers.push_back(&count);
+	for (auto& part : parts)
+		buffers.push_back(part.get());
+	input = std::make_shared<const Buffer>(Buffer::packBuffers(buffers, Buffer::BufferType::Vector));
+	return ERROR_SUCCESS;
+}
+
+/** Runs the task on this Slave, the returned status is sent back to the Master together with the result. */
+static int executeTask(TaskKind kind, SerializedData& task, const Buffer* input, Buffer& result)
+{
+	const FunctionRegistry& registry = FunctionRegistry::instance();
+	std::string functionId, combinerId;
+	task.peek(TaskField::function, functionId);
+	task.peek(TaskField::combiner, combinerId);
+
+	switch (kind)
+	{
+	case TaskKind::Map:
+	{
+		const FunctionRegistry::MapFunction* map = registry.findMap(functionId);
+		const FunctionRegistry::CombineFunction* combine = combinerId.empty() ? nullptr : registry.findCombine(combinerId);
+		if (map == nullptr || (!combinerId.empty() && combine == nullptr))
+			return ERROR_INVALID_FUNCTION;
+		if (input == nullptr)
+			return ERROR_NOT_FOUND;
+
+		result = (*map)(*input);
+		if (combine != nullptr)		// Only one value per partition leaves this node
+			result = (*combine)(result);
+		return ERROR_SUCCESS;
+	}
+	case TaskKind::Reduce:
+	{
+		const FunctionRegistry::CombineFunction* combine = registry.findCombine(functionId);
+		if (combine == nullptr)
+			return ERROR_INVALID_FUNCTION;
+		if (input == nullptr)
+			return ERROR_NOT_FOUND;
+
+		result = (*combine)(*input);
+		return ERROR_SUCCESS;
+	}
+	case TaskKind::For:
+	{
+		const FunctionRegistry::ForFunction* function = registry.findFor(functionId);
+		if (function == nullptr)
+			return ERROR_INVALID_FUNCTION;
+
+		size_t begin = 0, end = 0;
+		task.peek(TaskField::begin, begin);
+		task.peek(TaskField::end, end);
+		for (size_t i = begin; i < end; i++)
+			(*function)(i);
+		result = BasicSerializer<size_t>::serialize(end - begin);
+		return ERROR_SUCCESS;
+	}
+	default:
+		return ERROR_INVALID_PARAMETER;
+	}
+}
+
+int main(int argc, char* argv[])
 {
-	std::cout << "Hello World!\n";
-	std::cin.get();
+	const std::string hostname = argc > 1 ? argv[1] : "localhost";
+	const int port = argc > 2 ? std::stoi(argv[2]) : defaultMasterPort;
+	const size_t cacheCapacity = argc > 3 ? size_t(std::stoul(argv[3])) << 20 : defaultDatasetCacheCapacity;
+	const std::string capturePath = argc > 4 ? argv[4] : "";		// Records the traffic with the Master, see Replay
+	registerBuiltinFunctions();
+	DatasetCache cache(cacheCapacity);
+
+	PeerExchange exchange;
+	if (int error = exchange.start(); error)
+		exitWithError("Nu s-a putut porni schimbul de date cu celelalte Slave-uri, error = ", error);
+
+	ClientSocket* master = CreateClientSocket();
+	ScopeGuard deleteSocket([master] { DeleteClientSocket(master); });
+	master->enableFlowControl();
+	master->enableChannels();
+	if (!capturePath.empty())
+		if (int error = master->enableCapture(capturePath); error)
+			exitWithError("Nu s-a putut porni captura traficului, error = ", error);
+	if (int error = master->connect(hostname, port); error)
+		exitWithError("Nu s-a putut realiza conexiunea la Master, error = ", error);
+	SerializedData registration;
+	registration.add(TaskField::peerPort, exchange.getPort());
+	if (int error = master->sendBuffer(registration); error)
+		exitWithError("Nu s-a putut trimite portul pentru celelalte Slave-uri, error = ", error);
+
+	Buffer message;		// Kept between tasks, so its memory is reused
+	for (;;)
+	{
+		if (int error = master->receiveBuffer(message); error)
+			exitWithError("Nu s-a putut primi un task de la Master, error = ", error);
+
+		SerializedData task = SerializedData::view(message);
+		int kind = int(TaskKind::Shutdown);
+		task.peek(TaskField::kind, kind);
+		if (TaskKind(kind) == TaskKind::Shutdown)
+			break;
+		if (TaskKind(kind) == TaskKind::Release)
+		{
+			std::vector<DatasetId> released;
+			task.peek(TaskField::released, released);
+			exchange.release(released);
+			continue;
+		}
+
+		size_t taskId = 0;
+		task.peek(TaskField::taskId, taskId);
+		Buffer inlineInput, result;
+		bool resident = false;
+		std::vector<DatasetId> evicted;
+		std::shared_ptr<const Buffer> intermediate;
+		int status = task.contains(TaskField::inputs) ? resolveIntermediates(task, exchange, intermediate) : ERROR_SUCCESS;
+		const Buffer* input = intermediate != nullptr ? intermediate.get() : resolveInput(task, cache, inlineInput, resident, evicted);
+		if (status == ERROR_SUCCESS)
+			status = executeTask(TaskKind(kind), task, input, result);
+		if (status != ERROR_SUCCESS)
+			_log_("Task-ul ", taskId, " nu a putut fi executat, error = ", status);
+
+		// The output of a task graph node stays here for the nodes that take it, the Master gets it only if asked
+		DatasetId outputId = 0;
+		bool fetch = true;
+		const bool kept = status == ERROR_SUCCESS && task.peek(TaskField::output, outputId);
+		task.peek(TaskField::fetch, fetch);
+
+		SerializedData reply;
+		reply.add(TaskField::taskId, taskId);
+		reply.add(TaskField::status, status);
+		reply.add(TaskField::resident, resident);
+		reply.add(TaskField::evicted, evicted);
+		if (kept)
+			reply.add(TaskField::outputSize, result.getSize());
+		if (fetch && status == ERROR_SUCCESS)		// A failed task has no result, the Master reads only the status
+			reply.addBuffer(TaskField::result, kept ? Buffer(result) : std::move(result));
+		if (kept)
+			exchange.keep(outputId, std::move(result));
+		if (int error = master->sendBuffer(reply); error)
+			exitWithError("Nu s-a putut trimite rezultatul la Master, error = ", error);
+	}
 }